@@ -68,6 +68,17 @@ if (HAVE_THREADS)
     target_compile_definitions(libretro-common PUBLIC HAVE_THREADS)
 endif ()
 
+if (HAVE_ZLIB)
+    # archive_file.c (used to checksum ROMs) needs the zip backend whenever HAVE_ZLIB is defined
+    target_sources(libretro-common PRIVATE
+        ${libretro-common_SOURCE_DIR}/file/archive_file_zlib.c
+        ${libretro-common_SOURCE_DIR}/streams/trans_stream_zlib.c
+        )
+
+    target_compile_definitions(libretro-common PUBLIC HAVE_ZLIB)
+    target_link_libraries(libretro-common PUBLIC ZLIB::ZLIB)
+endif ()
+
 if (NOT HAVE_STRL)
     target_sources(libretro-common PRIVATE
         ${libretro-common_SOURCE_DIR}/compat/compat_strl.c
@@ -82,7 +93,6 @@ endif ()
 # TODO: Detect if cocoatouch is available; if so, define HAVE_COCOATOUCH
 # TODO: Detect if OpenGL ES is available; if so, define HAVE_OPENGLES(_?[123](_[12])?)?
 # TODO: Detect if SSL is available; if so, define HAVE_SSL
-# TODO: Detect if zlib is available; if so, define HAVE_ZLIB (do this when I get around to supporting compressed GBA saves)
 
 if (HAVE_OPENGL)
     target_sources(libretro-common PRIVATE
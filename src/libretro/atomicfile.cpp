@@ -0,0 +1,48 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "atomicfile.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <cstdlib>
+
+#include <encodings/utf.h>
+#endif
+
+#include <streams/file_stream.h>
+
+bool melonds::RenameOver(const char *from, const char *to) noexcept {
+    if (!from || !to)
+        return false;
+
+    // POSIX rename replaces the target atomically
+    if (filestream_rename(from, to) == 0)
+        return true;
+
+#if defined(_WIN32)
+    // Windows' rename refuses to overwrite an existing file, but MoveFileEx can replace it in one step
+    wchar_t *wide_from = utf8_to_utf16_string_alloc(from);
+    wchar_t *wide_to = utf8_to_utf16_string_alloc(to);
+    bool moved = wide_from && wide_to &&
+        MoveFileExW(wide_from, wide_to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    free(wide_from);
+    free(wide_to);
+    return moved;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,28 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_ATOMICFILE_HPP
+#define MELONDS_DS_ATOMICFILE_HPP
+
+namespace melonds {
+    /// Moves the file at \c from to \c to, replacing \c to in one step if it exists.
+    /// There's never a moment where \c to is missing or only partly written,
+    /// so this is how a freshly-written temporary file should take the place of the real one.
+    /// \return true on success; on failure, both files are left as they were.
+    bool RenameOver(const char *from, const char *to) noexcept;
+}
+
+#endif //MELONDS_DS_ATOMICFILE_HPP
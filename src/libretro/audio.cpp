@@ -0,0 +1,463 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "audio.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <audio/audio_resampler.h>
+#include <audio/conversion/float_to_s16.h>
+#include <audio/conversion/s16_to_float.h>
+#include <libretro.h>
+#include <SPU.h>
+
+#include "config.hpp"
+#include "environment.hpp"
+#include "ringbuffer.hpp"
+#include "timing.hpp"
+
+namespace melonds::audio {
+    // Stereo frames are stored as interleaved samples
+    constexpr size_t CHANNELS = 2;
+
+    // How much audio we read from the SPU at once, in stereo frames
+    constexpr size_t SPU_CHUNK_SIZE = 1024;
+
+    // How much audio we submit per invocation of the frontend's audio callback, in stereo frames
+    constexpr size_t CALLBACK_CHUNK_SIZE = 512;
+
+    // Enough room for one resampled SPU chunk at the highest supported output rate
+    constexpr size_t RESAMPLED_CHUNK_SIZE = SPU_CHUNK_SIZE * 2;
+
+    // The most that dynamic rate control may stretch or squeeze the audio;
+    // small enough that the change in pitch isn't audible
+    constexpr double MAX_RATE_CONTROL_DELTA = 0.005;
+
+    // How full we try to keep the frontend's own audio buffer when submitting audio once per frame, in percent
+    constexpr double TARGET_FRONTEND_OCCUPANCY = 50.0;
+    constexpr double LOW_LATENCY_TARGET_FRONTEND_OCCUPANCY = 25.0;
+
+    // How much audio we try to keep buffered in low-latency mode, in video frames' worth
+    constexpr unsigned LOW_LATENCY_BUFFERED_VIDEO_FRAMES = 2;
+
+    // Video frames per second, rounded up so that the low-latency target errs on the short side
+    constexpr unsigned VIDEO_FPS = 60;
+
+    // Marks the moment that the emulator started producing the audio up to a given position in the stream
+    struct LatencyMarker {
+        // Total stereo frames written to the buffer (including this batch) at the time of reading
+        uint64_t position;
+        retro_time_t timestamp;
+    };
+
+    static SpscRingBuffer<int16_t> _buffer(BUFFER_CAPACITY * CHANNELS);
+
+    // Set by the frontend through retro_audio_callback::set_state
+    static std::atomic_bool _callback_active {false};
+
+    // True if the frontend accepted our audio callback for this session
+    static bool _using_callback = false;
+
+    // How full the frontend's audio buffer is (0-100), as reported before each frame when audio is submitted per frame.
+    // Negative if the frontend hasn't reported it (or doesn't support reporting it).
+    // The frontend reports it on the thread that calls retro_run, so it's not atomic.
+    static int _frontend_occupancy = -1;
+
+    static std::atomic<uint64_t> _underruns {0};
+    static std::atomic<uint64_t> _overruns {0};
+    static std::atomic<uint64_t> _dropped_frames {0};
+    static std::atomic<size_t> _peak_fill {0};
+
+    static void *_resampler = nullptr;
+    static const retro_resampler_t *_resampler_backend = nullptr;
+    static unsigned _resampler_output_rate = NATIVE_SAMPLE_RATE;
+    static TimingStats _resampler_timing;
+
+    // Producer side of the latency measurements
+    static SpscRingBuffer<LatencyMarker> _latency_markers(64);
+    static uint64_t _frames_written = 0;
+
+    // Consumer side of the latency measurements
+    static uint64_t _frames_consumed = 0;
+    static LatencyMarker _pending_marker {};
+    static bool _has_pending_marker = false;
+    static TimingStats _latency;
+    static std::atomic<uint64_t> _trimmed_frames {0};
+
+    // Copy of Config::Retro::LowLatencyAudio that's safe to read from the frontend's audio thread
+    static std::atomic_bool _low_latency {false};
+
+    // Copy of OutputSampleRate() that's safe to read from the frontend's audio thread
+    static std::atomic<unsigned> _output_rate {NATIVE_SAMPLE_RATE};
+
+    // Frames of silence submitted during underruns that haven't been made up for yet;
+    // only touched by the audio callback
+    static size_t _silence_debt = 0;
+
+    static void audio_callback() noexcept;
+    static void audio_set_state(bool enabled) noexcept;
+    static void audio_buffer_status(bool active, unsigned occupancy, bool underrun_likely) noexcept;
+    static void update_resampler();
+    static void free_resampler() noexcept;
+    static size_t resample(const int16_t *input, size_t frames, int16_t *output);
+    static size_t target_fill() noexcept;
+    static void consume(size_t frames, bool handed_off) noexcept;
+}
+
+void melonds::audio::Init() {
+    _using_callback = false;
+    _callback_active = false;
+    _frontend_occupancy = -1;
+    _buffer.Clear();
+    _underruns = 0;
+    _overruns = 0;
+    _dropped_frames = 0;
+    _peak_fill = 0;
+    _resampler_timing.Reset();
+    _latency_markers.Clear();
+    _frames_written = 0;
+    _frames_consumed = 0;
+    _has_pending_marker = false;
+    _latency.Reset();
+    _trimmed_frames = 0;
+    _silence_debt = 0;
+    _output_rate = OutputSampleRate();
+
+    // Selects the SIMD implementations of the sample conversion loops, if available
+    convert_s16_to_float_init_simd();
+    convert_float_to_s16_init_simd();
+
+    if (Config::Retro::AudioDelivery == AudioDeliveryMode::Callback) {
+        // If the player wants the frontend to pull audio on its own schedule...
+        struct retro_audio_callback callback {
+            .callback = audio_callback,
+            .set_state = audio_set_state,
+        };
+
+        _using_callback = retro::environment(RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, &callback);
+        if (_using_callback) {
+            retro::info("Audio will be submitted through the frontend's audio callback");
+        } else {
+            retro::warn("Frontend does not support audio callbacks; audio will be submitted once per frame");
+        }
+    }
+
+    if (!_using_callback) {
+        // Our own buffer is emptied every frame, so dynamic rate control steers by the frontend's buffer instead
+        struct retro_audio_buffer_status_callback status {
+            .callback = audio_buffer_status,
+        };
+
+        if (!retro::environment(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, &status)) {
+            retro::debug("Frontend doesn't report its audio buffer status; in-core dynamic rate control is disabled");
+        }
+    }
+}
+
+void melonds::audio::DeInit() {
+    AudioStats stats = Stats();
+    retro::info(
+        "Audio: %llu underruns, %llu overruns (%llu frames dropped), peak buffer use %zu/%zu frames",
+        static_cast<unsigned long long>(stats.underruns),
+        static_cast<unsigned long long>(stats.overruns),
+        static_cast<unsigned long long>(stats.dropped_frames),
+        stats.peak_fill,
+        _buffer.Capacity() / CHANNELS
+    );
+
+    if (_resampler_timing.Count() > 0) {
+        retro::info(
+            "Resampling to %u Hz took %.1fus per frame on average (min %lldus, max %lldus, %llu frames)",
+            _resampler_output_rate,
+            _resampler_timing.Average(),
+            static_cast<long long>(_resampler_timing.Min()),
+            static_cast<long long>(_resampler_timing.Max()),
+            static_cast<unsigned long long>(_resampler_timing.Count())
+        );
+    }
+
+    if (_latency.Count() > 0) {
+        retro::info(
+            "Audio latency from start of frame to frontend callback: %.1fus on average (min %lldus, max %lldus, %llu batches), %llu frames trimmed",
+            _latency.Average(),
+            static_cast<long long>(_latency.Min()),
+            static_cast<long long>(_latency.Max()),
+            static_cast<unsigned long long>(_latency.Count()),
+            static_cast<unsigned long long>(_trimmed_frames.load(std::memory_order_relaxed))
+        );
+    }
+
+    if (!_using_callback) {
+        retro::environment(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, nullptr);
+    }
+
+    free_resampler();
+    _callback_active = false;
+    _using_callback = false;
+    _frontend_occupancy = -1;
+}
+
+void melonds::audio::RenderAudio(retro_time_t frame_start) {
+    static int16_t spu_buffer[SPU_CHUNK_SIZE * CHANNELS];
+    static int16_t resampled_buffer[RESAMPLED_CHUNK_SIZE * CHANNELS];
+
+    update_resampler();
+
+    retro_time_t resampling_time = 0;
+    uint64_t frames_written_before = _frames_written;
+    _low_latency.store(Config::Retro::LowLatencyAudio, std::memory_order_relaxed);
+    _output_rate.store(OutputSampleRate(), std::memory_order_relaxed);
+
+    // Drain everything the SPU has produced, not just what fits in one chunk;
+    // anything we leave behind would otherwise pile up in the SPU.
+    int available;
+    while ((available = SPU::GetOutputSize()) > 0) {
+        int frames_read = SPU::ReadOutput(spu_buffer, std::min<int>(available, SPU_CHUNK_SIZE));
+        if (frames_read <= 0)
+            break;
+
+        const int16_t *output = spu_buffer;
+        size_t output_frames = frames_read;
+        if (_resampler) {
+            // If we're converting the audio to the frontend's preferred sample rate...
+            retro_time_t start = cpu_features_get_time_usec();
+            output_frames = resample(spu_buffer, frames_read, resampled_buffer);
+            output = resampled_buffer;
+            resampling_time += cpu_features_get_time_usec() - start;
+        }
+
+        size_t samples_produced = output_frames * CHANNELS;
+        size_t samples_written = _buffer.Write(output, samples_produced);
+        if (samples_written < samples_produced) {
+            // If the frontend isn't consuming audio as quickly as we produce it...
+            _overruns.fetch_add(1, std::memory_order_relaxed);
+            _dropped_frames.fetch_add((samples_produced - samples_written) / CHANNELS, std::memory_order_relaxed);
+        }
+
+        _frames_written += samples_written / CHANNELS;
+    }
+
+    if (_using_callback && _frames_written > frames_written_before) {
+        // Submitting audio once per frame hands it off right away, so latency is only worth measuring for the callback.
+        // If the marker queue is full then the consumer is far behind anyway; this measurement is simply lost
+        LatencyMarker marker {_frames_written, frame_start};
+        _latency_markers.Write(&marker, 1);
+    }
+
+    if (_resampler) {
+        _resampler_timing.Add(resampling_time);
+    }
+
+    size_t fill = BufferedFrames();
+    if (fill > _peak_fill.load(std::memory_order_relaxed)) {
+        _peak_fill.store(fill, std::memory_order_relaxed);
+    }
+
+    if (_using_callback)
+        // The frontend will pull audio on its own thread
+        return;
+
+    static int16_t submit_buffer[BUFFER_CAPACITY * CHANNELS];
+    size_t samples = _buffer.Read(submit_buffer, sizeof(submit_buffer) / sizeof(submit_buffer[0]));
+    if (samples > 0) {
+        retro::audio_sample_batch(submit_buffer, samples / CHANNELS);
+    }
+}
+
+unsigned melonds::audio::OutputSampleRate() {
+    return Config::Retro::AudioOutputRate == 0 ? NATIVE_SAMPLE_RATE : Config::Retro::AudioOutputRate;
+}
+
+size_t melonds::audio::BufferedFrames() {
+    return _buffer.Size() / CHANNELS;
+}
+
+melonds::audio::AudioStats melonds::audio::Stats() {
+    return AudioStats {
+        .underruns = _underruns.load(std::memory_order_relaxed),
+        .overruns = _overruns.load(std::memory_order_relaxed),
+        .dropped_frames = _dropped_frames.load(std::memory_order_relaxed),
+        .peak_fill = _peak_fill.load(std::memory_order_relaxed),
+    };
+}
+
+// May be called on the frontend's audio thread, so this must not touch the SPU
+static void melonds::audio::audio_callback() noexcept {
+    static int16_t callback_buffer[CALLBACK_CHUNK_SIZE * CHANNELS];
+
+    if (!_callback_active.load(std::memory_order_acquire))
+        return;
+
+    if (_low_latency.load(std::memory_order_relaxed)) {
+        // If the player wants low latency, throw out audio that's fallen too far behind;
+        // we'd rather skip a few milliseconds than play everything late from now on.
+        size_t buffered = BufferedFrames();
+        size_t target = target_fill();
+        if (buffered > target) {
+            size_t trimmed = _buffer.Skip((buffered - target) * CHANNELS) / CHANNELS;
+            _trimmed_frames.fetch_add(trimmed, std::memory_order_relaxed);
+            consume(trimmed, false);
+        }
+    }
+
+    if (_silence_debt > 0) {
+        // If we padded an earlier underrun with silence, that silence is still sitting in the frontend's buffer;
+        // skip as much audio as we can spare so that it doesn't add latency for the rest of the session.
+        size_t buffered = BufferedFrames();
+        if (buffered > CALLBACK_CHUNK_SIZE) {
+            size_t skip = std::min(_silence_debt, buffered - CALLBACK_CHUNK_SIZE);
+            size_t skipped = _buffer.Skip(skip * CHANNELS) / CHANNELS;
+            _silence_debt -= skipped;
+            _trimmed_frames.fetch_add(skipped, std::memory_order_relaxed);
+            consume(skipped, false);
+        }
+    }
+
+    size_t samples = _buffer.Read(callback_buffer, CALLBACK_CHUNK_SIZE * CHANNELS);
+    if (samples == 0) {
+        // If the emulator hasn't produced any audio in time...
+        _underruns.fetch_add(1, std::memory_order_relaxed);
+
+        // Submit a little silence so that the frontend's audio device doesn't starve,
+        // and remember to make up for it once the emulator catches up
+        memset(callback_buffer, 0, sizeof(callback_buffer));
+        retro::audio_sample_batch(callback_buffer, CALLBACK_CHUNK_SIZE);
+        _silence_debt += CALLBACK_CHUNK_SIZE;
+        return;
+    }
+
+    retro::audio_sample_batch(callback_buffer, samples / CHANNELS);
+    consume(samples / CHANNELS, true);
+}
+
+static void melonds::audio::audio_set_state(bool enabled) noexcept {
+    retro::debug("Audio callback %s", enabled ? "enabled" : "disabled");
+    _callback_active.store(enabled, std::memory_order_release);
+}
+
+// Called by the frontend before each frame, on the same thread as retro_run
+static void melonds::audio::audio_buffer_status(bool active, unsigned occupancy, bool) noexcept {
+    _frontend_occupancy = active ? static_cast<int>(std::min(occupancy, 100u)) : -1;
+}
+
+static void melonds::audio::update_resampler() {
+    unsigned output_rate = OutputSampleRate();
+    if (output_rate == NATIVE_SAMPLE_RATE && !_using_callback) {
+        // If the frontend is getting the SPU's output as-is...
+        // (The callback keeps the resampler even at the native rate, because dynamic rate control needs it)
+        free_resampler();
+        return;
+    }
+
+    if (_resampler && output_rate == _resampler_output_rate)
+        // If the resampler is already set up for the requested rate...
+        return;
+
+    double ratio = static_cast<double>(output_rate) / NATIVE_SAMPLE_RATE;
+    if (!retro_resampler_realloc(&_resampler, &_resampler_backend, "sinc", RESAMPLER_QUALITY_HIGHER, ratio)) {
+        retro::error("Failed to initialize the audio resampler; audio will be output at %u Hz", NATIVE_SAMPLE_RATE);
+        _resampler = nullptr;
+        _resampler_backend = nullptr;
+        _resampler_output_rate = NATIVE_SAMPLE_RATE;
+        return;
+    }
+
+    _resampler_output_rate = output_rate;
+    _resampler_timing.Reset();
+    if (output_rate == NATIVE_SAMPLE_RATE)
+        retro::info("Resampling audio at %u Hz for dynamic rate control", output_rate);
+    else
+        retro::info("Resampling audio from %u Hz to %u Hz", NATIVE_SAMPLE_RATE, output_rate);
+}
+
+static void melonds::audio::free_resampler() noexcept {
+    if (_resampler && _resampler_backend) {
+        _resampler_backend->free(_resampler);
+    }
+
+    _resampler = nullptr;
+    _resampler_backend = nullptr;
+    _resampler_output_rate = NATIVE_SAMPLE_RATE;
+}
+
+static size_t melonds::audio::resample(const int16_t *input, size_t frames, int16_t *output) {
+    // Aligned so that the SIMD conversion paths can use aligned loads and stores
+    alignas(16) static float float_input[SPU_CHUNK_SIZE * CHANNELS];
+    alignas(16) static float float_output[RESAMPLED_CHUNK_SIZE * CHANNELS];
+
+    double ratio = static_cast<double>(_resampler_output_rate) / NATIVE_SAMPLE_RATE;
+    if (_using_callback) {
+        // If the frontend pulls audio on its own schedule, our buffer's fill level tells us
+        // whether we're producing audio faster or slower than it's being played.
+        // Stretch or squeeze the output slightly to keep the buffer near its target fill level.
+        double target = static_cast<double>(target_fill());
+        double error = std::clamp((target - BufferedFrames()) / target, -1.0, 1.0);
+        ratio *= 1.0 + MAX_RATE_CONTROL_DELTA * error;
+    } else if (_frontend_occupancy >= 0) {
+        // If we submit audio once per frame, our buffer is always empty afterwards,
+        // so the frontend's buffer is the one to keep near its target instead
+        double target = _low_latency.load(std::memory_order_relaxed) ?
+            LOW_LATENCY_TARGET_FRONTEND_OCCUPANCY :
+            TARGET_FRONTEND_OCCUPANCY;
+        double error = std::clamp((target - _frontend_occupancy) / target, -1.0, 1.0);
+        ratio *= 1.0 + MAX_RATE_CONTROL_DELTA * error;
+    }
+
+    convert_s16_to_float(float_input, input, frames * CHANNELS, 1.0f);
+
+    struct resampler_data data {};
+    data.data_in = float_input;
+    data.data_out = float_output;
+    data.input_frames = frames;
+    data.ratio = ratio;
+    _resampler_backend->process(_resampler, &data);
+
+    size_t output_frames = std::min(data.output_frames, RESAMPLED_CHUNK_SIZE);
+    convert_float_to_s16(output, float_output, output_frames * CHANNELS);
+
+    return output_frames;
+}
+
+// The number of stereo frames we'd like to keep buffered when the frontend pulls audio through the callback
+static size_t melonds::audio::target_fill() noexcept {
+    if (_low_latency.load(std::memory_order_relaxed))
+        return _output_rate.load(std::memory_order_relaxed) * LOW_LATENCY_BUFFERED_VIDEO_FRAMES / VIDEO_FPS;
+
+    return BUFFER_CAPACITY / 2;
+}
+
+// Must only be called by the buffer's consumer.
+// Records how long the audio that was just removed from the buffer took to get there.
+static void melonds::audio::consume(size_t frames, bool handed_off) noexcept {
+    _frames_consumed += frames;
+    retro_time_t now = cpu_features_get_time_usec();
+
+    while (_has_pending_marker || _latency_markers.Read(&_pending_marker, 1)) {
+        if (_pending_marker.position > _frames_consumed) {
+            // If the frontend hasn't received all of this batch yet...
+            _has_pending_marker = true;
+            return;
+        }
+
+        if (handed_off) {
+            // Trimmed audio never reaches the frontend, so it doesn't count
+            _latency.Add(now - _pending_marker.timestamp);
+        }
+        _has_pending_marker = false;
+    }
+}
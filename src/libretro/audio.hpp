@@ -0,0 +1,76 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_AUDIO_HPP
+#define MELONDS_DS_AUDIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <libretro.h>
+
+namespace melonds::audio {
+    using std::size_t;
+
+    /// The rate at which the emulated SPU produces audio.
+    constexpr unsigned NATIVE_SAMPLE_RATE = 32768;
+
+    /// Size of the buffer between the emulated SPU and the frontend, in stereo frames.
+    /// About a quarter of a second at the DS's native sample rate.
+    constexpr size_t BUFFER_CAPACITY = 8192;
+
+    struct AudioStats {
+        /// Number of times the frontend asked for audio when none was buffered.
+        uint64_t underruns;
+
+        /// Number of times the SPU produced more audio than the buffer could hold.
+        uint64_t overruns;
+
+        /// Number of stereo frames discarded due to overruns.
+        uint64_t dropped_frames;
+
+        /// The largest number of stereo frames that were buffered at once.
+        size_t peak_fill;
+    };
+
+    /// Prepares the audio buffer for a newly-loaded game.
+    /// Must be called from retro_load_game, as that's the only place
+    /// where the frontend will accept an audio callback.
+    void Init();
+
+    /// Logs the collected audio statistics.
+    void DeInit();
+
+    /// Moves all available audio from the emulated SPU into the buffer.
+    /// If the frontend isn't pulling audio through a callback,
+    /// the buffer is also submitted to the frontend.
+    /// melonDS only makes the SPU's output available at the end of each emulated frame,
+    /// so this should be called once per frame right after NDS::RunFrame.
+    /// \param frame_start When the frame that produced this audio started emulating;
+    /// latency is measured from here when the frontend pulls audio through a callback.
+    void RenderAudio(retro_time_t frame_start);
+
+    /// The sample rate of the audio we submit to the frontend.
+    /// Differs from NATIVE_SAMPLE_RATE if the player enabled in-core resampling.
+    unsigned OutputSampleRate();
+
+    /// The number of stereo frames waiting to be submitted to the frontend.
+    size_t BufferedFrames();
+
+    AudioStats Stats();
+}
+
+#endif //MELONDS_DS_AUDIO_HPP
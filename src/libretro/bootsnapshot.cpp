@@ -0,0 +1,516 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "bootsnapshot.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <compat/strl.h>
+#include <encodings/crc32.h>
+#include <file/file_path.h>
+#include <retro_miscellaneous.h>
+#include <streams/file_stream.h>
+#include <streams/rzip_stream.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include <GBACart.h>
+#include <NDS.h>
+#include <NDSCart.h>
+#include <Platform.h>
+#include <Savestate.h>
+#include <frontend/qt_sdl/Config.h>
+
+#include "atomicfile.hpp"
+#include "config.hpp"
+#include "content.hpp"
+#include "environment.hpp"
+#include "memory.hpp"
+#include "timing.hpp"
+
+namespace melonds::bootsnapshot {
+    // "MDBS", stored at the start of the file, followed by the key's length, the key, and the savestate
+    constexpr u32 MAGIC = 0x5342444D;
+
+    // How long to wait for the BIOS to start the game before giving up on capturing a snapshot.
+    // Generous, since some firmware waits for the player to touch the health and safety screen.
+    constexpr unsigned MAX_BOOT_FRAMES = 60 * 60;
+
+    static bool _enabled = false;
+    static std::string _path;
+    static std::string _key;
+    static std::vector<u8> _state;
+
+    // True while the BIOS is booting the game and we're waiting to capture the result
+    static bool _capturing = false;
+    static unsigned _boot_frames = 0;
+    static retro_time_t _boot_start = 0;
+
+    // The complete snapshot file, owned by the writer thread while it's running
+    static std::vector<u8> _file;
+#ifdef HAVE_THREADS
+    static sthread_t *_writer = nullptr;
+#endif
+
+    static TimingStats _restore_timing;
+    static TimingStats _capture_timing;
+    static TimingStats _reset_timing;
+
+    static std::string snapshot_key();
+    static uint32_t rom_crc() noexcept;
+    static uint32_t gba_rom_crc() noexcept;
+    static uint32_t bios_crc() noexcept;
+    static uint32_t config_crc() noexcept;
+    static bool load_state(const std::vector<u8> &state) noexcept;
+    static bool save_state(std::vector<u8> &state, size_t size) noexcept;
+    static u32 read_rom_u32(const u8 *rom, u32 offset) noexcept;
+    static bool game_started() noexcept;
+    static void capture_state();
+    static bool read_snapshot_file(std::vector<u8> &state);
+    static void write_snapshot_file();
+    static void write_file() noexcept;
+    static void wait_for_writer() noexcept;
+#ifdef HAVE_THREADS
+    static void writer_main(void *);
+#endif
+}
+
+void melonds::bootsnapshot::Init(bool homebrew) {
+    wait_for_writer();
+    _enabled = false;
+    _capturing = false;
+    _path.clear();
+    _key.clear();
+    _state.clear();
+    _restore_timing.Reset();
+    _capture_timing.Reset();
+    _reset_timing.Reset();
+
+    if (!Config::Retro::BootSnapshot)
+        return;
+
+    if (Config::ConsoleType == ConsoleType::DSi || homebrew || Config::Retro::RandomizeMac || !NDSCart::CartROM) {
+        // DSi savestates aren't reliable, homebrew keeps state on its SD card,
+        // and a randomized MAC address is supposed to be different every boot
+        retro::debug("Boot snapshots aren't available for this game and configuration");
+        return;
+    }
+
+    if (Config::DirectBoot || NDS::NeedsDirectBoot()) {
+        // Direct boot skips the BIOS and jumps straight into the game, so there's nothing for a snapshot to skip
+        retro::debug("Boot snapshots are only used when booting through the BIOS");
+        return;
+    }
+
+    const std::optional<std::string> &save_directory = retro::get_save_directory();
+    const std::optional<struct retro_game_info> &nds_info = retro::content::get_loaded_nds_info();
+    if (!save_directory || !nds_info || !nds_info->path) {
+        retro::debug("No save directory or game path available, boot snapshots are disabled");
+        return;
+    }
+
+    char game_name[PATH_MAX_LENGTH];
+    const char *ptr = path_basename(nds_info->path);
+    strlcpy(game_name, ptr ? ptr : nds_info->path, sizeof(game_name));
+    path_remove_extension(game_name);
+
+    char path[PATH_MAX_LENGTH];
+    fill_pathname_join_special(path, save_directory->c_str(), game_name, sizeof(path));
+    _path = std::string(path) + ".boot.state";
+    _key = snapshot_key();
+    _enabled = true;
+}
+
+void melonds::bootsnapshot::DeInit() {
+    if (_restore_timing.Count() || _capture_timing.Count() || _reset_timing.Count()) {
+        retro::info(
+            "Boot snapshots: restored %llu times (%.1fms each), captured %llu times (%.1fms each), "
+            "reset from memory %llu times (%.1fms each)",
+            static_cast<unsigned long long>(_restore_timing.Count()),
+            _restore_timing.Average() / 1000.0,
+            static_cast<unsigned long long>(_capture_timing.Count()),
+            _capture_timing.Average() / 1000.0,
+            static_cast<unsigned long long>(_reset_timing.Count()),
+            _reset_timing.Average() / 1000.0
+        );
+    }
+
+    // The snapshot must reach the disk before the next game can reuse the path
+    wait_for_writer();
+    _enabled = false;
+    _capturing = false;
+    _path.clear();
+    _key.clear();
+    _state = std::vector<u8>();
+}
+
+bool melonds::bootsnapshot::Restore() {
+    if (!_enabled)
+        return false;
+
+    ScopedTimer timer(_restore_timing);
+    if (!read_snapshot_file(_state))
+        return false;
+
+    if (!load_state(_state)) {
+        // The snapshot passed the key check, but melonDS still rejected it
+        retro::warn("Failed to load the boot snapshot from \"%s\", discarding it", _path.c_str());
+        _state.clear();
+        filestream_delete(_path.c_str());
+        return false;
+    }
+
+    retro::info("Booted from snapshot \"%s\"", _path.c_str());
+    return true;
+}
+
+void melonds::bootsnapshot::Capture() {
+    if (!_enabled || !_state.empty())
+        return;
+
+    _capturing = true;
+    _boot_frames = 0;
+    _boot_start = cpu_features_get_time_usec();
+}
+
+void melonds::bootsnapshot::Update() {
+    if (!_capturing)
+        return;
+
+    _boot_frames++;
+    if (game_started()) {
+        _capturing = false;
+
+        // This is the time that loading the snapshot saves on later boots
+        retro::info(
+            "The BIOS booted the game in %u frames (%.1fms)",
+            _boot_frames,
+            (cpu_features_get_time_usec() - _boot_start) / 1000.0
+        );
+        capture_state();
+    } else if (_boot_frames >= MAX_BOOT_FRAMES) {
+        _capturing = false;
+        retro::warn("The BIOS didn't start the game within %u frames, so no boot snapshot was captured", MAX_BOOT_FRAMES);
+    }
+}
+
+bool melonds::bootsnapshot::Reset() {
+    if (!_enabled || _state.empty())
+        return false;
+
+    ScopedTimer timer(_reset_timing);
+
+    // NDS::Reset leaves the carts' save data alone, so loading the snapshot mustn't roll it back either
+    std::vector<u8> nds_save;
+    if (NDSCart::GetSaveMemory() && NDSCart::GetSaveMemoryLength() > 0) {
+        const u8 *save = NDSCart::GetSaveMemory();
+        nds_save.assign(save, save + NDSCart::GetSaveMemoryLength());
+    }
+
+    if (!load_state(_state)) {
+        retro::warn("Failed to reset from the boot snapshot, resetting normally");
+        _state.clear();
+        return false;
+    }
+
+    if (!nds_save.empty()) {
+        NDS::LoadSave(nds_save.data(), nds_save.size());
+    }
+
+    if (GBACart::CartROM && GbaSaveManager && GbaSaveManager->SramLength() > 0) {
+        // The GBA save manager always has the cart's latest SRAM
+        GBACart::LoadSave(GbaSaveManager->Sram(), GbaSaveManager->SramLength());
+    }
+
+    return true;
+}
+
+static bool melonds::bootsnapshot::load_state(const std::vector<u8> &state) noexcept {
+    Savestate savestate(const_cast<u8 *>(state.data()), state.size(), false);
+    return NDS::DoSavestate(&savestate) && !savestate.Error;
+}
+
+// Serializes the emulator into a buffer of the given size, then trims the buffer to what melonDS used
+static bool melonds::bootsnapshot::save_state(std::vector<u8> &state, size_t size) noexcept {
+    state.resize(size);
+    u32 length = 0;
+    {
+        Savestate savestate(state.data(), state.size(), true);
+        if (!NDS::DoSavestate(&savestate) || savestate.Error) {
+            state.clear();
+            return false;
+        }
+
+        length = savestate.Length();
+    } // melonDS finishes writing the savestate's header when it's destroyed
+
+    state.resize(length);
+    return true;
+}
+
+static u32 melonds::bootsnapshot::read_rom_u32(const u8 *rom, u32 offset) noexcept {
+    return rom[offset] | (rom[offset + 1] << 8) | (rom[offset + 2] << 16) | (static_cast<u32>(rom[offset + 3]) << 24);
+}
+
+// True once the BIOS has loaded the game's ARM7 binary, which it does last, right before starting the game.
+// The ARM9 binary isn't checked because its secure area is encrypted in the ROM when booting through the BIOS,
+// and because games often decompress it in place as soon as they start.
+static bool melonds::bootsnapshot::game_started() noexcept {
+    const u8 *rom = NDSCart::CartROM;
+    u32 rom_size = NDSCart::CartROMSize;
+    if (!rom || rom_size < 0x200)
+        return false;
+
+    // The ARM7 binary's ROM offset, entry point, RAM address, and size are at 0x30, 0x34, 0x38, and 0x3C
+    u32 offset = read_rom_u32(rom, 0x30);
+    u32 entry = read_rom_u32(rom, 0x34);
+    u32 ram_address = read_rom_u32(rom, 0x38);
+    u32 size = read_rom_u32(rom, 0x3C);
+    constexpr u32 CHECKED_BYTES = 16;
+    if (size < CHECKED_BYTES || offset >= rom_size || size > rom_size - offset)
+        return false;
+
+    if (entry < ram_address || entry - ram_address > size - CHECKED_BYTES)
+        return false;
+
+    u32 entry_offset = offset + (entry - ram_address);
+    for (u32 i = 0; i < CHECKED_BYTES; i += 4) {
+        if (NDS::ARM7Read32(entry + i) != read_rom_u32(rom, entry_offset + i))
+            return false;
+    }
+
+    return true;
+}
+
+static void melonds::bootsnapshot::capture_state() {
+    ScopedTimer timer(_capture_timing);
+
+    // Usually known (or cached) already, since frontends ask for it when the game loads
+    size_t size = raw_savestate_size();
+    if (size == 0 || !save_state(_state, size)) {
+        // If the size is unknown or out of date, let melonDS allocate as it goes to find out the real size
+        Savestate measure;
+        if (!NDS::DoSavestate(&measure) || measure.Error || !save_state(_state, measure.Length())) {
+            retro::warn("Failed to capture the boot snapshot");
+            return;
+        }
+    }
+
+    write_snapshot_file();
+}
+
+// Everything the booted state depends on: the savestate format, the code that gets booted,
+// the BIOS and firmware that boot it, and the options that change how it boots
+static std::string melonds::bootsnapshot::snapshot_key() {
+    char key[128];
+    snprintf(
+        key,
+        sizeof(key),
+        "v%d.%d_rom%08x_gba%08x_bios%08x_cfg%08x",
+        SAVESTATE_MAJOR,
+        SAVESTATE_MINOR,
+        rom_crc(),
+        gba_rom_crc(),
+        bios_crc(),
+        config_crc()
+    );
+
+    return key;
+}
+
+// Hashes the header and the ARM9 and ARM7 binaries, which are the only parts of the ROM that booting reads;
+// the header includes checksums of itself and the secure area
+static uint32_t melonds::bootsnapshot::rom_crc() noexcept {
+    const u8 *rom = NDSCart::CartROM;
+    u32 rom_size = NDSCart::CartROMSize;
+    if (!rom || rom_size < 0x200)
+        return 0;
+
+    uint32_t crc = encoding_crc32(0, rom, 0x200);
+    for (u32 header_offset : {0x20u, 0x30u}) {
+        // The ARM9 binary's offset and size are at 0x20 and 0x2C; the ARM7's are at 0x30 and 0x3C
+        u32 offset = read_rom_u32(rom, header_offset);
+        u32 size = read_rom_u32(rom, header_offset + 0xC);
+        if (offset < rom_size && size <= rom_size - offset) {
+            crc = encoding_crc32(crc, rom + offset, size);
+        }
+    }
+
+    return crc ^ rom_size;
+}
+
+// The GBA cart's state is part of the snapshot, so a different GBA game invalidates it
+static uint32_t melonds::bootsnapshot::gba_rom_crc() noexcept {
+    if (!GBACart::CartROM || GBACart::CartROMSize == 0)
+        return 0;
+
+    return encoding_crc32(0, GBACart::CartROM, GBACart::CartROMSize) ^ GBACart::CartROMSize;
+}
+
+static uint32_t melonds::bootsnapshot::bios_crc() noexcept {
+    // NDS::Reset already loaded the BIOS (external or FreeBIOS) into memory
+    uint32_t crc = encoding_crc32(0, NDS::ARM9BIOS, sizeof(NDS::ARM9BIOS));
+    crc = encoding_crc32(crc, NDS::ARM7BIOS, sizeof(NDS::ARM7BIOS));
+
+    if (Config::ExternalBIOSEnable) {
+        // Served from the system file cache, so this doesn't read the disk again
+        FILE *firmware = Platform::OpenLocalFile(Config::FirmwarePath, "rb");
+        if (firmware) {
+            u8 buffer[4096];
+            size_t read;
+            while ((read = fread(buffer, 1, sizeof(buffer), firmware)) > 0) {
+                crc = encoding_crc32(crc, buffer, read);
+            }
+            fclose(firmware);
+        }
+    }
+
+    return crc;
+}
+
+// Includes every firmware setting the core can override (they're written into the firmware before it boots),
+// and the renderer and JIT options, since melonDS doesn't promise that states carry over between them
+static uint32_t melonds::bootsnapshot::config_crc() noexcept {
+#ifdef JIT_ENABLED
+    int jit = Config::JIT_Enable;
+#else
+    int jit = 0;
+#endif
+    char config[512];
+    snprintf(
+        config,
+        sizeof(config),
+        "bios=%d;direct=%d;override=%d;lang=%d;user=%s;birthday=%d/%d;colour=%d;message=%s;mac=%s;renderer=%d;jit=%d",
+        Config::ExternalBIOSEnable,
+        Config::DirectBoot,
+        Config::FirmwareOverrideSettings,
+        Config::FirmwareLanguage,
+        Config::FirmwareUsername.c_str(),
+        Config::FirmwareBirthdayMonth,
+        Config::FirmwareBirthdayDay,
+        Config::FirmwareFavouriteColour,
+        Config::FirmwareMessage.c_str(),
+        Config::FirmwareMAC.c_str(),
+        static_cast<int>(Config::Retro::ConfiguredRenderer),
+        jit
+    );
+
+    return encoding_crc32(0, reinterpret_cast<const uint8_t *>(config), strlen(config));
+}
+
+static bool melonds::bootsnapshot::read_snapshot_file(std::vector<u8> &state) {
+    // rzipstream opens the file as-is if it's not compressed
+    rzipstream_t *file = rzipstream_open(_path.c_str(), RETRO_VFS_FILE_ACCESS_READ);
+    if (!file) {
+        retro::debug("No boot snapshot at \"%s\"", _path.c_str());
+        return false;
+    }
+
+    int64_t size = rzipstream_get_size(file);
+    u32 header[2] = {0, 0};
+    bool ok = size > static_cast<int64_t>(sizeof(header)) &&
+              rzipstream_read(file, header, sizeof(header)) == sizeof(header) &&
+              header[0] == MAGIC &&
+              header[1] == _key.size();
+
+    std::string key(ok ? header[1] : 0, '\0');
+    ok = ok && rzipstream_read(file, key.data(), key.size()) == static_cast<int64_t>(key.size());
+    if (ok && key != _key) {
+        // If the game, BIOS, or options changed since the snapshot was taken...
+        retro::info("Boot snapshot \"%s\" is out of date, discarding it", _path.c_str());
+        rzipstream_close(file);
+        filestream_delete(_path.c_str());
+        return false;
+    }
+
+    int64_t state_size = size - static_cast<int64_t>(sizeof(header) + key.size());
+    ok = ok && state_size > 0;
+    if (ok) {
+        state.resize(state_size);
+        ok = rzipstream_read(file, state.data(), state_size) == state_size;
+    }
+    rzipstream_close(file);
+
+    if (!ok) {
+        retro::warn("Boot snapshot \"%s\" is invalid, discarding it", _path.c_str());
+        state.clear();
+        filestream_delete(_path.c_str());
+    }
+
+    return ok;
+}
+
+// Storage can be slow, so the file is written on its own thread; the in-memory snapshot is usable right away
+static void melonds::bootsnapshot::write_snapshot_file() {
+    wait_for_writer();
+
+    u32 header[2] = {MAGIC, static_cast<u32>(_key.size())};
+    _file.resize(sizeof(header) + _key.size() + _state.size());
+    memcpy(_file.data(), header, sizeof(header));
+    memcpy(_file.data() + sizeof(header), _key.data(), _key.size());
+    memcpy(_file.data() + sizeof(header) + _key.size(), _state.data(), _state.size());
+
+#ifdef HAVE_THREADS
+    _writer = sthread_create(writer_main, nullptr);
+    if (_writer)
+        return;
+
+    retro::warn("Failed to start the boot snapshot writer thread, writing on this thread instead");
+#endif
+    write_file();
+}
+
+#ifdef HAVE_THREADS
+static void melonds::bootsnapshot::writer_main(void *) {
+    write_file();
+}
+#endif
+
+static void melonds::bootsnapshot::wait_for_writer() noexcept {
+#ifdef HAVE_THREADS
+    if (_writer) {
+        sthread_join(_writer);
+        _writer = nullptr;
+    }
+#endif
+    _file = std::vector<u8>();
+}
+
+// Written to a temporary file first so that a crash mid-write can't leave a truncated snapshot behind
+static void melonds::bootsnapshot::write_file() noexcept {
+    std::string temp_path = _path + ".tmp";
+#ifdef HAVE_ZLIB
+    bool written = rzipstream_write_file(temp_path.c_str(), _file.data(), _file.size());
+#else
+    bool written = filestream_write_file(temp_path.c_str(), _file.data(), _file.size());
+#endif
+    if (!written) {
+        retro::warn("Failed to write boot snapshot to \"%s\"", temp_path.c_str());
+        filestream_delete(temp_path.c_str());
+        return;
+    }
+
+    if (!RenameOver(temp_path.c_str(), _path.c_str())) {
+        retro::warn("Failed to move boot snapshot from \"%s\" to \"%s\"", temp_path.c_str(), _path.c_str());
+        filestream_delete(temp_path.c_str());
+        return;
+    }
+
+    retro::info("Wrote boot snapshot to \"%s\"", _path.c_str());
+}
@@ -0,0 +1,53 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_BOOTSNAPSHOT_HPP
+#define MELONDS_DS_BOOTSNAPSHOT_HPP
+
+/// Captures the emulator's state once the BIOS has booted the game,
+/// so that later boots and resets can load it instead of going through the BIOS again.
+/// Only used when booting through the BIOS; direct boot is already instant.
+/// Snapshots are kept in memory for retro_reset and on disk for the next time the game is loaded.
+namespace melonds::bootsnapshot {
+    /// Decides whether boot snapshots can be used for the loaded game,
+    /// and computes the key that a snapshot on disk must match to be used.
+    /// Call after NDS::Reset and after the carts are inserted, but before the game is booted.
+    /// \param homebrew True if the loaded game is homebrew, whose SD card state isn't captured in savestates.
+    void Init(bool homebrew);
+
+    /// Discards the in-memory snapshot and logs how much time snapshots saved.
+    void DeInit();
+
+    /// Loads this game's snapshot from disk in place of the usual boot sequence.
+    /// \return false if there's no usable snapshot, in which case boot normally and call Capture.
+    bool Restore();
+
+    /// Starts watching for the BIOS to finish booting the game, so that the result can be captured.
+    /// Call right after starting a normal boot. Does nothing if there's already a snapshot in memory.
+    void Capture();
+
+    /// Captures the snapshot once the BIOS has started the game,
+    /// keeping it in memory and writing it to disk on a background thread.
+    /// Call after every emulated frame; does nothing unless Capture was called.
+    void Update();
+
+    /// Loads the in-memory snapshot in place of NDS::Reset and the usual boot sequence.
+    /// The carts' save data is kept as it is now, not as it was when the snapshot was taken.
+    /// \return false if there's no snapshot, in which case reset normally.
+    bool Reset();
+}
+
+#endif //MELONDS_DS_BOOTSNAPSHOT_HPP
@@ -15,7 +15,9 @@
 */
 
 #include "config.hpp"
+#include <algorithm>
 #include <cstring>
+#include <cstdlib>
 #include <frontend/qt_sdl/Config.h>
 #include <GPU.h>
 #include <string/stdstring.h>
@@ -24,6 +26,7 @@
 #include "content.hpp"
 #include "libretro.hpp"
 #include "environment.hpp"
+#include "gameprofile.hpp"
 #include "screenlayout.hpp"
 #include "input.hpp"
 #include "opengl.hpp"
@@ -96,6 +99,21 @@ namespace Config {
         melonds::ScreenSwapMode ScreenSwapMode;
         melonds::Renderer CurrentRenderer;
         melonds::Renderer ConfiguredRenderer;
+        melonds::AudioDeliveryMode AudioDelivery = melonds::AudioDeliveryMode::PerFrame;
+        unsigned AudioOutputRate = 0;
+        bool LowLatencyAudio = false;
+        bool CompressSavestates = false;
+        bool RewindEnabled = false;
+        size_t RewindBudget = 128 * 1024 * 1024;
+        unsigned RewindInterval = 1;
+        melonds::HotkeyBinding RewindButton = melonds::HotkeyBinding::Keyboard;
+        melonds::HotkeyBinding QuickSaveButton = melonds::HotkeyBinding::Keyboard;
+        melonds::HotkeyBinding QuickLoadButton = melonds::HotkeyBinding::Keyboard;
+        bool FastSram = false;
+        bool LowMemoryRom = false;
+        bool StartupReport = false;
+        bool BootSnapshot = false;
+        bool JitAutoTune = false;
         float CursorSize = 2.0;
         int FlushDelay = 120; // TODO: Make configurable
 
@@ -120,6 +138,7 @@ namespace Config {
             static const char *const JIT_BRANCH_OPTIMISATIONS = "melonds_jit_branch_optimisations";
             static const char *const JIT_LITERAL_OPTIMISATIONS = "melonds_jit_literal_optimisations";
             static const char *const JIT_FAST_MEMORY = "melonds_jit_fast_memory";
+            static const char *const JIT_AUTOTUNE = "melonds_jit_autotune";
             static const char *const USE_EXTERNAL_BIOS = "melonds_use_external_bios";
             static const char *const CONSOLE_MODE = "melonds_console_mode";
             static const char *const BOOT_DIRECTLY = "melonds_boot_directly";
@@ -132,12 +151,26 @@ namespace Config {
             static const char *const MIC_INPUT = "melonds_mic_input";
             static const char *const AUDIO_BITRATE = "melonds_audio_bitrate";
             static const char *const AUDIO_INTERPOLATION = "melonds_audio_interpolation";
+            static const char *const AUDIO_DELIVERY = "melonds_audio_delivery";
+            static const char *const AUDIO_SAMPLE_RATE = "melonds_audio_sample_rate";
+            static const char *const AUDIO_LOW_LATENCY = "melonds_audio_low_latency";
             static const char *const USE_FIRMWARE_SETTINGS = "melonds_use_fw_settings";
             static const char *const LANGUAGE = "melonds_language";
             static const char *const HOMEBREW_SAVE_MODE = "melonds_homebrew_sdcard";
             static const char *const HOMEBREW_READ_ONLY = "melonds_homebrew_readonly";
             static const char *const HOMEBREW_DEDICATED_CARD_SIZE = "melonds_homebrew_dedicated_sdcard_size";
             static const char *const HOMEBREW_SYNC_TO_HOST = "melonds_homebrew_sync_sdcard_to_host";
+            static const char *const SAVESTATE_COMPRESSION = "melonds_savestate_compression";
+            static const char *const REWIND = "melonds_rewind";
+            static const char *const REWIND_BUDGET = "melonds_rewind_budget";
+            static const char *const REWIND_INTERVAL = "melonds_rewind_interval";
+            static const char *const REWIND_BUTTON = "melonds_rewind_button";
+            static const char *const QUICK_SAVE_BUTTON = "melonds_quick_save_button";
+            static const char *const QUICK_LOAD_BUTTON = "melonds_quick_load_button";
+            static const char *const FAST_SRAM = "melonds_fast_sram";
+            static const char *const LOW_MEMORY_ROM = "melonds_low_memory_rom";
+            static const char *const STARTUP_REPORT = "melonds_startup_report";
+            static const char *const BOOT_SNAPSHOT = "melonds_boot_snapshot";
         }
 
         namespace Values {
@@ -150,6 +183,14 @@ namespace Config {
             static const char *const SHARED2G = "shared2048m";
             static const char *const SHARED4G = "shared4096m";
             static const char *const DEDICATED = "dedicated";
+            static const char *const PER_FRAME = "frame";
+            static const char *const FRONTEND_CALLBACK = "callback";
+            static const char *const NATIVE = "native";
+            static const char *const KEYBOARD = "keyboard";
+            static const char *const L2 = "l2";
+            static const char *const R2 = "r2";
+            static const char *const L3 = "l3";
+            static const char *const R3 = "r3";
         }
     }
 }
@@ -163,6 +204,9 @@ namespace melonds::config {
 #endif
 
     static void check_homebrew_save_options(bool initializing);
+    static void check_savestate_options(bool initializing);
+    static void check_sram_options(bool initializing);
+    static melonds::HotkeyBinding parse_hotkey_binding(const char *value) noexcept;
 }
 
 GPU::RenderSettings Config::Retro::RenderSettings() {
@@ -256,6 +300,9 @@ bool melonds::update_option_visibility() {
         option_display.key = Keys::JIT_FAST_MEMORY;
         environment(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
 
+        option_display.key = Keys::JIT_AUTOTUNE;
+        environment(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+
         updated = true;
     }
 #endif
@@ -452,6 +499,13 @@ void melonds::check_variables(bool init) {
     if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
         Config::JIT_FastMemory = string_is_equal(var.value, Values::ENABLED);
     }
+
+    if (init) {
+        var.key = Keys::JIT_AUTOTUNE;
+        if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+            Config::Retro::JitAutoTune = string_is_equal(var.value, Values::ENABLED);
+        }
+    }
 #endif
 
     var.key = Keys::DSI_SDCARD;
@@ -467,26 +521,17 @@ void melonds::check_variables(bool init) {
             Config::MicInputType = static_cast<int>(MicInputMode::BlowNoise);
         else if (string_is_equal(var.value, "White Noise"))
             Config::MicInputType = static_cast<int>(MicInputMode::WhiteNoise);
+        else if (string_is_equal(var.value, "Tone"))
+            Config::MicInputType = static_cast<int>(MicInputMode::Tone);
+        else if (string_is_equal(var.value, "File"))
+            Config::MicInputType = static_cast<int>(MicInputMode::File);
         else
             Config::MicInputType = static_cast<int>(MicInputMode::None);
-
-        if (static_cast<MicInputMode>(Config::MicInputType) !=
-            MicInputMode::HostMic /*&& micInterface.interface_version && micHandle*/) {
-            // If the player wants to stop using the real mic as the DS mic's input...
-            // micInterface.set_mic_state(micHandle, false);
-        }
     }
 
     var.key = Keys::MIC_INPUT_BUTTON;
     if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
         Config::Retro::MicButtonRequired = string_is_equal(var.value, "With Button");
-
-//        if (noise_button_required &&
-//            micInterface.interface_version &&
-//            micHandle != NULL &&
-//            !input_state.holding_noise_btn) { // If the player wants to require the noise button for mic input and they aren't already holding it...
-//            micInterface.set_mic_state(micHandle, false);
-//        }
     }
 
     var.key = Keys::AUDIO_BITRATE;
@@ -511,6 +556,32 @@ void melonds::check_variables(bool init) {
             Config::AudioInterp = 0;
     }
 
+    if (init) {
+        // The audio callback can only be registered while loading a game
+        var.key = Keys::AUDIO_DELIVERY;
+        if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+            if (string_is_equal(var.value, Values::FRONTEND_CALLBACK))
+                Config::Retro::AudioDelivery = AudioDeliveryMode::Callback;
+            else
+                Config::Retro::AudioDelivery = AudioDeliveryMode::PerFrame;
+        }
+
+        // The sample rate is reported to the frontend in retro_get_system_av_info
+        var.key = Keys::AUDIO_SAMPLE_RATE;
+        if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+            unsigned rate = 0;
+            if (!string_is_equal(var.value, Values::NATIVE))
+                rate = static_cast<unsigned>(strtoul(var.value, nullptr, 10));
+
+            Config::Retro::AudioOutputRate = rate;
+        }
+    }
+
+    var.key = Keys::AUDIO_LOW_LATENCY;
+    if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+        Config::Retro::LowLatencyAudio = string_is_equal(var.value, Values::ENABLED);
+    }
+
     var.key = Keys::USE_FIRMWARE_SETTINGS;
     if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
         if (string_is_equal(var.value, Values::DISABLED))
@@ -540,7 +611,40 @@ void melonds::check_variables(bool init) {
         Config::ExternalBIOSEnable = string_is_equal(var.value, Values::ENABLED);
     }
 
+    var.key = Keys::STARTUP_REPORT;
+    if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+        Config::Retro::StartupReport = string_is_equal(var.value, Values::ENABLED);
+    }
+
+    // Hotkeys can be rebound mid-game
+    var.key = Keys::REWIND_BUTTON;
+    if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+        Config::Retro::RewindButton = config::parse_hotkey_binding(var.value);
+    }
+
+    var.key = Keys::QUICK_SAVE_BUTTON;
+    if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+        Config::Retro::QuickSaveButton = config::parse_hotkey_binding(var.value);
+    }
+
+    var.key = Keys::QUICK_LOAD_BUTTON;
+    if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+        Config::Retro::QuickLoadButton = config::parse_hotkey_binding(var.value);
+    }
+
+    if (init) {
+        var.key = Keys::BOOT_SNAPSHOT;
+        if (environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+            Config::Retro::BootSnapshot = string_is_equal(var.value, Values::ENABLED);
+        }
+    }
+
+    // Overrides whatever the core options just set, for the settings the game's profile covers
+    gameprofile::Apply(init);
+
     config::check_homebrew_save_options(init);
+    config::check_savestate_options(init);
+    config::check_sram_options(init);
 
     input_state.current_touch_mode = new_touch_mode;
 
@@ -549,6 +653,108 @@ void melonds::check_variables(bool init) {
     update_option_visibility();
 }
 
+/**
+ * Reads the frontend's savestate options and applies them to the core.
+ * @param initializing Whether the emulator is initializing a game.
+ * If false, options that would change the savestate size mid-game will not be updated.
+ */
+static void melonds::config::check_savestate_options(bool initializing) {
+    using namespace Config::Retro;
+    using retro::get_variable;
+
+    if (!initializing)
+        // Frontends expect retro_serialize_size to stay the same while a game is running
+        return;
+
+    struct retro_variable var = {nullptr, nullptr};
+
+#ifdef HAVE_ZLIB
+    var.key = Keys::SAVESTATE_COMPRESSION;
+    if (get_variable(&var) && var.value) {
+        Config::Retro::CompressSavestates = string_is_equal(var.value, Values::ENABLED);
+    } else {
+        Config::Retro::CompressSavestates = false;
+        retro::log(RETRO_LOG_WARN, "Failed to get value for %s; defaulting to %s", Keys::SAVESTATE_COMPRESSION, Values::DISABLED);
+    }
+#else
+    Config::Retro::CompressSavestates = false;
+#endif
+
+    var.key = Keys::REWIND;
+    if (get_variable(&var) && var.value) {
+        Config::Retro::RewindEnabled = string_is_equal(var.value, Values::ENABLED);
+    } else {
+        Config::Retro::RewindEnabled = false;
+        retro::log(RETRO_LOG_WARN, "Failed to get value for %s; defaulting to %s", Keys::REWIND, Values::DISABLED);
+    }
+
+    var.key = Keys::REWIND_BUDGET;
+    if (get_variable(&var) && var.value) {
+        Config::Retro::RewindBudget = strtoul(var.value, nullptr, 10) * 1024 * 1024;
+    } else {
+        Config::Retro::RewindBudget = 128 * 1024 * 1024;
+        retro::log(RETRO_LOG_WARN, "Failed to get value for %s; defaulting to %s", Keys::REWIND_BUDGET, "128");
+    }
+
+    var.key = Keys::REWIND_INTERVAL;
+    if (get_variable(&var) && var.value) {
+        Config::Retro::RewindInterval = std::max(1ul, strtoul(var.value, nullptr, 10));
+    } else {
+        Config::Retro::RewindInterval = 1;
+        retro::log(RETRO_LOG_WARN, "Failed to get value for %s; defaulting to %s", Keys::REWIND_INTERVAL, "1");
+    }
+}
+
+static melonds::HotkeyBinding melonds::config::parse_hotkey_binding(const char *value) noexcept {
+    using namespace Config::Retro;
+
+    if (string_is_equal(value, Values::DISABLED))
+        return HotkeyBinding::Disabled;
+    if (string_is_equal(value, Values::L2))
+        return HotkeyBinding::L2;
+    if (string_is_equal(value, Values::R2))
+        return HotkeyBinding::R2;
+    if (string_is_equal(value, Values::L3))
+        return HotkeyBinding::L3;
+    if (string_is_equal(value, Values::R3))
+        return HotkeyBinding::R3;
+
+    return HotkeyBinding::Keyboard;
+}
+
+bool melonds::check_low_memory_option() {
+    using namespace Config::Retro;
+
+    // Read before any content is loaded, since it decides what we ask the frontend for
+    const char *value = retro::get_variable(Keys::LOW_MEMORY_ROM);
+    LowMemoryRom = value && string_is_equal(value, Values::ENABLED);
+
+    return LowMemoryRom;
+}
+
+/**
+ * Reads the frontend's SRAM options and applies them to the core.
+ * @param initializing Whether the emulator is initializing a game.
+ * If false, the options will not be updated; the frontend holds onto the SRAM pointer for the whole session.
+ */
+static void melonds::config::check_sram_options(bool initializing) {
+    using namespace Config::Retro;
+    using retro::get_variable;
+
+    if (!initializing)
+        return;
+
+    struct retro_variable var = {nullptr, nullptr};
+
+    var.key = Keys::FAST_SRAM;
+    if (get_variable(&var) && var.value) {
+        Config::Retro::FastSram = string_is_equal(var.value, Values::ENABLED);
+    } else {
+        Config::Retro::FastSram = false;
+        retro::log(RETRO_LOG_WARN, "Failed to get value for %s; defaulting to %s", Keys::FAST_SRAM, Values::DISABLED);
+    }
+}
+
 /**
  * Reads the frontend's saved homebrew save data options and applies them to the emulator.
  * @param initializing Whether the emulator is initializing a game.
@@ -851,6 +1057,62 @@ struct retro_core_option_v2_definition melonds::option_defs_us[] = {
                 },
                 Config::Retro::Values::ENABLED
         },
+        {
+                Config::Retro::Keys::LOW_MEMORY_ROM,
+                "Low-Memory ROM Loading",
+                nullptr,
+                "If enabled, DS ROMs are read directly from disk as needed "
+                "instead of being loaded into memory by the frontend first. "
+                "Lowers peak memory use on devices with little RAM. "
+                "GBA ROMs are still loaded into memory, "
+                "as are DS ROMs from frontends that don't support this. "
+                "Changes take effect after restarting the core.",
+                nullptr,
+                "system",
+                {
+                    {Config::Retro::Values::DISABLED, nullptr},
+                    {Config::Retro::Values::ENABLED, nullptr},
+                    {nullptr, nullptr},
+                },
+                Config::Retro::Values::DISABLED
+        },
+        {
+                Config::Retro::Keys::BOOT_SNAPSHOT,
+                "Boot Snapshots",
+                nullptr,
+                "If enabled, the emulator's state once the BIOS has finished booting a game is saved "
+                "(in memory and next to the game's save data), "
+                "so that resetting or loading the game again can skip the boot process. "
+                "Snapshots are discarded when the game, BIOS, firmware, or boot options change. "
+                "Only used when booting through the BIOS, since direct boot is already instant. "
+                "Not available in DSi mode, for homebrew, or with a randomized MAC address. "
+                "Changes take effect with next restart.",
+                nullptr,
+                "system",
+                {
+                    {Config::Retro::Values::DISABLED, nullptr},
+                    {Config::Retro::Values::ENABLED, nullptr},
+                    {nullptr, nullptr},
+                },
+                Config::Retro::Values::DISABLED
+        },
+        {
+                Config::Retro::Keys::STARTUP_REPORT,
+                "Write Startup Report",
+                nullptr,
+                "If enabled, a breakdown of how long each step of loading a game took "
+                "is written to melondsds_startup.json in the save directory. "
+                "A summary is always logged. "
+                "Useful for tracking down slow startups.",
+                nullptr,
+                "system",
+                {
+                    {Config::Retro::Values::DISABLED, nullptr},
+                    {Config::Retro::Values::ENABLED, nullptr},
+                    {nullptr, nullptr},
+                },
+                Config::Retro::Values::DISABLED
+        },
 #ifdef HAVE_THREADS
         {
                 Config::Retro::Keys::THREADED_RENDERER,
@@ -940,13 +1202,18 @@ struct retro_core_option_v2_definition melonds::option_defs_us[] = {
                 Config::Retro::Keys::MIC_INPUT,
                 "Microphone Input",
                 nullptr,
-                "Choose the type of noise that will be used as microphone input.",
+                "Choose the type of noise that will be used as microphone input. "
+                "Tone plays a 441Hz sine wave. "
+                "File plays melondsds_mic.pcm from the system directory "
+                "(raw signed 16-bit little-endian mono audio at 44100Hz) on a loop.",
                 nullptr,
                 "audio",
                 {
                         {"Disabled", nullptr},
                         {"Blow Noise", nullptr},
                         {"White Noise", nullptr},
+                        {"Tone", nullptr},
+                        {"File", nullptr},
                         {"Microphone Input", nullptr},
                         {nullptr, nullptr},
                 },
@@ -997,6 +1264,63 @@ struct retro_core_option_v2_definition melonds::option_defs_us[] = {
                 },
                 "None"
         },
+        {
+                Config::Retro::Keys::AUDIO_DELIVERY,
+                "Audio Delivery",
+                nullptr,
+                "Determines how audio is handed to the frontend. "
+                "Per Frame submits all audio produced by each emulated frame at once. "
+                "Frontend Callback buffers audio and lets the frontend pull it when its audio device is ready, "
+                "so that audio no longer depends on video timing; not all frontends support this. "
+                "Changes take effect next time the core restarts. "
+                "If unsure, leave this at Per Frame.",
+                nullptr,
+                "audio",
+                {
+                        {Config::Retro::Values::PER_FRAME, "Per Frame"},
+                        {Config::Retro::Values::FRONTEND_CALLBACK, "Frontend Callback"},
+                        {nullptr, nullptr},
+                },
+                Config::Retro::Values::PER_FRAME
+        },
+        {
+                Config::Retro::Keys::AUDIO_SAMPLE_RATE,
+                "Audio Sample Rate",
+                nullptr,
+                "The sample rate of the audio given to the frontend. "
+                "Native outputs audio at the emulated DS's rate of 32768Hz and lets the frontend resample it. "
+                "Other values resample the audio within the core, "
+                "which can spare the frontend some work if the rate matches your audio device. "
+                "Changes take effect next time the core restarts. "
+                "If unsure, leave this at Native.",
+                nullptr,
+                "audio",
+                {
+                        {Config::Retro::Values::NATIVE, "Native (32768Hz)"},
+                        {"44100", "44100Hz"},
+                        {"48000", "48000Hz"},
+                        {nullptr, nullptr},
+                },
+                Config::Retro::Values::NATIVE
+        },
+        {
+                Config::Retro::Keys::AUDIO_LOW_LATENCY,
+                "Low-Latency Audio",
+                nullptr,
+                "Hands audio to the frontend before the frame is drawn, "
+                "and (with Frontend Callback delivery) discards buffered audio that falls too far behind. "
+                "Reduces audio latency for rhythm games, "
+                "but may cause crackling if the frontend's audio buffer is also small. "
+                "If unsure, leave this disabled.",
+                nullptr,
+                "audio",
+                {
+                        {Config::Retro::Values::DISABLED, nullptr},
+                        {Config::Retro::Values::ENABLED, nullptr},
+                        {nullptr, nullptr},
+                },
+                Config::Retro::Values::DISABLED
+        },
         {
                 Config::Retro::Keys::TOUCH_MODE,
                 "Touch Mode",
@@ -1279,6 +1603,159 @@ struct retro_core_option_v2_definition melonds::option_defs_us[] = {
             },
             "0",
         },
+        {
+            Config::Retro::Keys::FAST_SRAM,
+            "Fast SRAM",
+            nullptr,
+            "If enabled, the frontend reads and writes the cart's save memory directly "
+            "instead of a copy that's updated on every write. "
+            "Saves memory and time for games with large saves. "
+            "Not available with the OpenGL renderer. "
+            "Changes take effect with next restart.",
+            nullptr,
+            Config::Retro::Category::SAVE,
+            {
+                {Config::Retro::Values::DISABLED, nullptr},
+                {Config::Retro::Values::ENABLED, nullptr},
+                {nullptr, nullptr},
+            },
+            Config::Retro::Values::DISABLED
+        },
+#ifdef HAVE_ZLIB
+        {
+            Config::Retro::Keys::SAVESTATE_COMPRESSION,
+            "Compress Savestates",
+            nullptr,
+            "If enabled, savestates are compressed before they're given to the frontend. "
+            "This makes savestate files and rewind buffers much smaller, "
+            "but saving and loading will take a little longer. "
+            "Compressed and uncompressed savestates can both be loaded regardless of this setting. "
+            "Changes take effect with next restart.",
+            nullptr,
+            Config::Retro::Category::SAVE,
+            {
+                {Config::Retro::Values::DISABLED, nullptr},
+                {Config::Retro::Values::ENABLED, nullptr},
+                {nullptr, nullptr},
+            },
+            Config::Retro::Values::DISABLED
+        },
+#endif
+        {
+            Config::Retro::Keys::REWIND,
+            "Core Rewind",
+            nullptr,
+            "If enabled, the core keeps a history of recent frames "
+            "that can be stepped back through by holding the Core Rewind Button. "
+            "Only the parts of memory that changed between frames are kept. "
+            "Not supported in DSi mode. "
+            "Changes take effect with next restart.",
+            nullptr,
+            Config::Retro::Category::SAVE,
+            {
+                {Config::Retro::Values::DISABLED, nullptr},
+                {Config::Retro::Values::ENABLED, nullptr},
+                {nullptr, nullptr},
+            },
+            Config::Retro::Values::DISABLED
+        },
+        {
+            Config::Retro::Keys::REWIND_BUDGET,
+            "Core Rewind Memory Budget",
+            nullptr,
+            "The most memory that the rewind history may use. "
+            "When it's full, the oldest frames are forgotten. "
+            "Changes take effect with next restart.",
+            nullptr,
+            Config::Retro::Category::SAVE,
+            {
+                {"64", "64 MiB"},
+                {"128", "128 MiB"},
+                {"256", "256 MiB"},
+                {"512", "512 MiB"},
+                {"1024", "1 GiB"},
+                {nullptr, nullptr},
+            },
+            "128"
+        },
+        {
+            Config::Retro::Keys::REWIND_INTERVAL,
+            "Core Rewind Granularity",
+            nullptr,
+            "How many frames pass between each entry in the rewind history. "
+            "Higher values make rewinding faster and cheaper, but coarser. "
+            "Changes take effect with next restart.",
+            nullptr,
+            Config::Retro::Category::SAVE,
+            {
+                {"1", "Every frame"},
+                {"2", "Every 2 frames"},
+                {"4", "Every 4 frames"},
+                {"8", "Every 8 frames"},
+                {nullptr, nullptr},
+            },
+            "1"
+        },
+        {
+            Config::Retro::Keys::REWIND_BUTTON,
+            "Core Rewind Button",
+            nullptr,
+            "The button to hold to step back through the rewind history. "
+            "A controller button chosen here stops doing what it usually does, "
+            "and can be remapped in the frontend's controls menu like any other.",
+            nullptr,
+            Config::Retro::Category::SAVE,
+            {
+                {Config::Retro::Values::KEYBOARD, "Backspace (Keyboard)"},
+                {Config::Retro::Values::L2, "L2 (instead of microphone noise)"},
+                {Config::Retro::Values::R2, "R2 (instead of swapping screens)"},
+                {Config::Retro::Values::L3, "L3 (instead of closing the lid)"},
+                {Config::Retro::Values::R3, "R3 (instead of touching with the joystick)"},
+                {Config::Retro::Values::DISABLED, nullptr},
+                {nullptr, nullptr},
+            },
+            Config::Retro::Values::KEYBOARD
+        },
+        {
+            Config::Retro::Keys::QUICK_SAVE_BUTTON,
+            "Quick Save Button",
+            nullptr,
+            "The button that saves the game to the quick save slot, which is written to disk in the background. "
+            "A controller button chosen here stops doing what it usually does, "
+            "and can be remapped in the frontend's controls menu like any other.",
+            nullptr,
+            Config::Retro::Category::SAVE,
+            {
+                {Config::Retro::Values::KEYBOARD, "Page Up (Keyboard)"},
+                {Config::Retro::Values::L2, "L2 (instead of microphone noise)"},
+                {Config::Retro::Values::R2, "R2 (instead of swapping screens)"},
+                {Config::Retro::Values::L3, "L3 (instead of closing the lid)"},
+                {Config::Retro::Values::R3, "R3 (instead of touching with the joystick)"},
+                {Config::Retro::Values::DISABLED, nullptr},
+                {nullptr, nullptr},
+            },
+            Config::Retro::Values::KEYBOARD
+        },
+        {
+            Config::Retro::Keys::QUICK_LOAD_BUTTON,
+            "Quick Load Button",
+            nullptr,
+            "The button that loads the game from the quick save slot. "
+            "A controller button chosen here stops doing what it usually does, "
+            "and can be remapped in the frontend's controls menu like any other.",
+            nullptr,
+            Config::Retro::Category::SAVE,
+            {
+                {Config::Retro::Values::KEYBOARD, "Page Down (Keyboard)"},
+                {Config::Retro::Values::L2, "L2 (instead of microphone noise)"},
+                {Config::Retro::Values::R2, "R2 (instead of swapping screens)"},
+                {Config::Retro::Values::L3, "L3 (instead of closing the lid)"},
+                {Config::Retro::Values::R3, "R3 (instead of touching with the joystick)"},
+                {Config::Retro::Values::DISABLED, nullptr},
+                {nullptr, nullptr},
+            },
+            Config::Retro::Values::KEYBOARD
+        },
 #ifdef HAVE_OPENGL
         {
                 Config::Retro::Keys::HYBRID_RATIO,
@@ -1398,6 +1875,24 @@ struct retro_core_option_v2_definition melonds::option_defs_us[] = {
                 },
                 Config::Retro::Values::ENABLED
         },
+        {
+                Config::Retro::Keys::JIT_AUTOTUNE,
+                "JIT Block Size Auto-Tuning",
+                nullptr,
+                "If enabled, the first half-minute or so of play is spent trying several JIT block sizes, "
+                "and the fastest one is used for that game from then on (overriding JIT Block Size). "
+                "Results are saved in melondsds_jit_tuning.cfg in the save directory; "
+                "remove a game's entry to tune it again. "
+                "Changes take effect with next restart.",
+                nullptr,
+                "cpu",
+                {
+                        {Config::Retro::Values::DISABLED, nullptr},
+                        {Config::Retro::Values::ENABLED, nullptr},
+                        {nullptr, nullptr},
+                },
+                Config::Retro::Values::DISABLED
+        },
 #endif
         {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, {{nullptr}}, nullptr},
 };
@@ -17,6 +17,7 @@
 #ifndef MELONDS_DS_CONFIG_HPP
 #define MELONDS_DS_CONFIG_HPP
 
+#include <cstddef>
 #ifdef HAVE_OPENGL
 #include <glsym/glsym.h>
 #endif
@@ -26,6 +27,10 @@
 namespace melonds {
     bool update_option_visibility();
     void check_variables(bool init);
+
+    /// Reads the low-memory ROM option on its own, since it's needed before content is loaded.
+    /// \return true if DS ROMs should be mapped from disk instead of loaded by the frontend.
+    bool check_low_memory_option();
     extern struct retro_core_options_v2 options_us;
     extern struct retro_core_option_v2_definition option_defs_us[];
 #ifndef HAVE_NO_LANGEXTRA
@@ -49,6 +54,28 @@ namespace melonds {
         OpenGl = 1,
     };
 
+    enum class AudioDeliveryMode {
+        /// Audio is submitted to the frontend once per frame, after the frame is emulated.
+        PerFrame,
+
+        /// Audio is buffered and the frontend pulls it via RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK.
+        Callback,
+    };
+
+    /// Where the core reads one of its own hotkeys (such as rewind) from.
+    enum class HotkeyBinding {
+        Disabled,
+
+        /// The hotkey's own key on the keyboard.
+        Keyboard,
+
+        /// One of these joypad buttons, which stops doing what it usually does.
+        L2,
+        R2,
+        L3,
+        R3,
+    };
+
     /// The order of these values is important.
     enum class FirmwareLanguage
     {
@@ -68,6 +95,47 @@ namespace Config::Retro {
     extern melonds::ScreenSwapMode ScreenSwapMode;
     extern melonds::Renderer CurrentRenderer;
     extern melonds::Renderer ConfiguredRenderer;
+    extern melonds::AudioDeliveryMode AudioDelivery;
+
+    // The sample rate to resample audio to, or 0 to output audio at the SPU's native rate.
+    extern unsigned AudioOutputRate;
+
+    // If true, audio is handed to the frontend as soon as it's produced and kept to a short buffer.
+    extern bool LowLatencyAudio;
+
+    // If true, savestates are compressed with zlib before they're handed to the frontend.
+    extern bool CompressSavestates;
+
+    // If true, the core keeps its own history of recent frames that can be rewound through.
+    extern bool RewindEnabled;
+
+    // The most memory that the rewind history may use, in bytes.
+    extern size_t RewindBudget;
+
+    // The number of frames between each entry in the rewind history.
+    extern unsigned RewindInterval;
+
+    // The button that steps back through the rewind history while held.
+    extern melonds::HotkeyBinding RewindButton;
+
+    // The buttons that save and load the quick save slot.
+    extern melonds::HotkeyBinding QuickSaveButton;
+    extern melonds::HotkeyBinding QuickLoadButton;
+
+    // If true, the frontend is given the cart's own save memory rather than a copy of it.
+    extern bool FastSram;
+
+    // If true, DS ROMs are mapped from disk instead of being loaded into memory by the frontend.
+    extern bool LowMemoryRom;
+
+    // If true, a JSON breakdown of the last game's startup time is written to the save directory.
+    extern bool StartupReport;
+
+    // If true, the state right after booting is kept (in memory and on disk) so that boots and resets can skip ahead.
+    extern bool BootSnapshot;
+
+    // If true, several JIT block sizes are tried during play, and the fastest is remembered for the game.
+    extern bool JitAutoTune;
 
     // The number of frames to wait for the save data buffer to not change before saving.
     extern int FlushDelay;
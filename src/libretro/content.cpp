@@ -71,7 +71,7 @@ void retro::content::set_loaded_content_info(
         _loaded_nds_path = nds_info->path ? make_optional(nds_info->path) : nullopt;
         _loaded_nds_info = retro_game_info {
             .path = _loaded_nds_path ? _loaded_nds_path->c_str() : nullptr,
-            .data = nds_info->data, // QUESTION: Should we copy this?
+            .data = nds_info->data, // Only valid until release_data() is called
             .size = nds_info->size,
             .meta = nds_info->meta, // QUESTION: Should we copy this?
         };
@@ -84,7 +84,7 @@ void retro::content::set_loaded_content_info(
         _loaded_gba_path = gba_info->path ? make_optional(gba_info->path) : nullopt;
         _loaded_gba_info = retro_game_info {
             .path = _loaded_gba_path ? _loaded_gba_path->c_str() : nullptr,
-            .data = gba_info->data, // QUESTION: Should we copy this?
+            .data = gba_info->data, // Only valid until release_data() is called
             .size = gba_info->size,
             .meta = gba_info->meta, // QUESTION: Should we copy this?
         };
@@ -97,7 +97,7 @@ void retro::content::set_loaded_content_info(
         _loaded_gba_save_path = gba_save_info->path ? make_optional(gba_save_info->path) : nullopt;
         _loaded_gba_save_info = retro_game_info {
             .path = _loaded_gba_save_path ? _loaded_gba_save_path->c_str() : nullptr,
-            .data = gba_save_info->data, // QUESTION: Should we copy this?
+            .data = gba_save_info->data, // Only valid until release_data() is called
             .size = gba_save_info->size,
             .meta = gba_save_info->meta, // QUESTION: Should we copy this?
         };
@@ -117,6 +117,30 @@ void retro::content::set_loaded_content_info(
     }
 }
 
+void retro::content::release_data() noexcept {
+    // The frontend doesn't keep content buffers around past retro_load_game,
+    // so make sure nobody tries to read them later
+    if (_loaded_nds_info) {
+        _loaded_nds_info->data = nullptr;
+    }
+
+    if (_loaded_nds_info_ext) {
+        _loaded_nds_info_ext->data = nullptr;
+    }
+
+    if (_loaded_gba_info) {
+        _loaded_gba_info->data = nullptr;
+    }
+
+    if (_loaded_gba_info_ext) {
+        _loaded_gba_info_ext->data = nullptr;
+    }
+
+    if (_loaded_gba_save_info) {
+        _loaded_gba_save_info->data = nullptr;
+    }
+}
+
 void retro::content::clear() noexcept {
     _loaded_nds_info = nullopt;
     _loaded_nds_info_ext = nullopt;
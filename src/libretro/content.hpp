@@ -40,6 +40,11 @@ namespace retro::content {
         const struct retro_game_info* gba_save_info
     ) noexcept;
 
+    /// Forgets the content's data buffers (but not its paths or metadata).
+    /// Call once the loaded ROMs have been parsed,
+    /// as the frontend is free to release its copy once retro_load_game returns.
+    void release_data() noexcept;
+
     void clear() noexcept;
 }
 
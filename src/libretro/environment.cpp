@@ -321,7 +321,9 @@ PUBLIC_SYMBOL void retro_set_environment(retro_environment_t cb) {
     struct retro_core_options_update_display_callback update_display_cb{melonds::update_option_visibility};
     environment(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK, &update_display_cb);
 
-    environment(RETRO_ENVIRONMENT_SET_CONTENT_INFO_OVERRIDE, (void *) melonds::content_overrides);
+    const retro_system_content_info_override *overrides = melonds::check_low_memory_option() ?
+        melonds::low_memory_content_overrides : melonds::content_overrides;
+    environment(RETRO_ENVIRONMENT_SET_CONTENT_INFO_OVERRIDE, (void *) overrides);
     environment(RETRO_ENVIRONMENT_SET_CONTROLLER_INFO, (void *) melonds::ports);
 
     retro_log_callback log_callback = {nullptr};
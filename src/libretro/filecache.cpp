@@ -0,0 +1,208 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "filecache.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <streams/file_stream.h>
+#include <types.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include <frontend/qt_sdl/Config.h>
+
+#include "environment.hpp"
+
+namespace melonds::filecache {
+    // Bigger than any BIOS or firmware image; anything larger isn't what we think it is
+    constexpr int64_t MAX_FILE_SIZE = 4 * 1024 * 1024;
+
+    struct Entry {
+        std::shared_ptr<const std::vector<u8>> data;
+        int64_t size;
+        int64_t mtime;
+    };
+
+    static std::unordered_map<std::string, Entry> _entries;
+
+    // Contents that were replaced or forgotten while a stream might still be reading them.
+    // melonDS closes its streams with fclose, so we can't tell when they're done;
+    // these are kept alive until DeInit instead, when nothing is reading system files anymore.
+    // (Only a file that changed on disk or was written to ends up here, so this rarely holds anything.)
+    static std::vector<std::shared_ptr<const std::vector<u8>>> _retired;
+    static uint64_t _hits = 0;
+    static uint64_t _misses = 0;
+
+#ifdef HAVE_THREADS
+    // The BIOS task checks for the system files while the main thread may be opening others
+    static slock_t *_lock = nullptr;
+#endif
+
+    /// Holds the cache's lock (if there is one) for the rest of the scope.
+    class LockGuard {
+    public:
+        LockGuard() noexcept {
+#ifdef HAVE_THREADS
+            if (_lock)
+                slock_lock(_lock);
+#endif
+        }
+
+        ~LockGuard() noexcept {
+#ifdef HAVE_THREADS
+            if (_lock)
+                slock_unlock(_lock);
+#endif
+        }
+
+        LockGuard(const LockGuard &) = delete;
+
+        LockGuard &operator=(const LockGuard &) = delete;
+    };
+
+    static bool stat_file(const std::string &path, int64_t &size, int64_t &mtime) noexcept;
+    static FILE *open_memory(const Entry &entry) noexcept;
+    static void retire(const std::string &path) noexcept;
+}
+
+bool melonds::filecache::IsCacheable(const std::string &name) noexcept {
+#ifdef _WIN32
+    // Windows has no fmemopen, so a cached file would have to be opened from disk anyway
+    (void) name;
+    return false;
+#else
+    // The NAND and SD card images are huge and get written to, so they're not included
+    return name == Config::BIOS9Path || name == Config::BIOS7Path || name == Config::FirmwarePath ||
+           name == Config::DSiBIOS9Path || name == Config::DSiBIOS7Path || name == Config::DSiFirmwarePath;
+#endif
+}
+
+void melonds::filecache::Init() noexcept {
+#ifdef HAVE_THREADS
+    if (!_lock)
+        _lock = slock_new();
+#endif
+}
+
+FILE *melonds::filecache::Open(const std::string &path) noexcept {
+    LockGuard guard;
+    int64_t size = 0, mtime = 0;
+    if (!stat_file(path, size, mtime)) {
+        // If the file doesn't exist (anymore)...
+        retire(path);
+        return nullptr;
+    }
+
+    auto cached = _entries.find(path);
+    if (cached != _entries.end() && cached->second.size == size && cached->second.mtime == mtime) {
+        _hits++;
+        return open_memory(cached->second);
+    }
+
+    if (size <= 0 || size > MAX_FILE_SIZE)
+        return nullptr;
+
+    void *data = nullptr;
+    int64_t length = 0;
+    if (!filestream_read_file(path.c_str(), &data, &length) || !data) {
+        retire(path);
+        return nullptr;
+    }
+
+    _misses++;
+    retire(path);
+    Entry &entry = _entries[path];
+    entry.data = std::make_shared<const std::vector<u8>>(
+        static_cast<const u8 *>(data),
+        static_cast<const u8 *>(data) + length
+    );
+    entry.size = size;
+    entry.mtime = mtime;
+    free(data);
+
+    retro::debug("Cached %lld-byte system file \"%s\"", static_cast<long long>(length), path.c_str());
+    return open_memory(entry);
+}
+
+void melonds::filecache::Forget(const std::string &path) noexcept {
+    LockGuard guard;
+    retire(path);
+}
+
+void melonds::filecache::DeInit() noexcept {
+    {
+        LockGuard guard;
+        if (_hits || _misses) {
+            retro::info(
+                "System file cache served %llu opens from memory and read %llu files from disk",
+                static_cast<unsigned long long>(_hits),
+                static_cast<unsigned long long>(_misses)
+            );
+        }
+
+        _entries.clear();
+        _retired.clear();
+        _hits = 0;
+        _misses = 0;
+    }
+
+#ifdef HAVE_THREADS
+    if (_lock) {
+        slock_free(_lock);
+        _lock = nullptr;
+    }
+#endif
+}
+
+static bool melonds::filecache::stat_file(const std::string &path, int64_t &size, int64_t &mtime) noexcept {
+    struct stat info {};
+    if (stat(path.c_str(), &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG)
+        return false;
+
+    size = info.st_size;
+    mtime = info.st_mtime;
+    return true;
+}
+
+// The stream reads straight out of the entry's buffer, so the buffer must outlive it; see retire()
+static FILE *melonds::filecache::open_memory(const Entry &entry) noexcept {
+#ifdef _WIN32
+    // Unreachable, since IsCacheable never lets a file in
+    (void) entry;
+    return nullptr;
+#else
+    // The stream only reads, but fmemopen wants a non-const buffer
+    return fmemopen(const_cast<u8 *>(entry.data->data()), entry.data->size(), "rb");
+#endif
+}
+
+// Drops path from the cache without freeing its contents, in case a stream is still reading them.
+// Must be called with the lock held.
+static void melonds::filecache::retire(const std::string &path) noexcept {
+    auto entry = _entries.find(path);
+    if (entry == _entries.end())
+        return;
+
+    _retired.push_back(std::move(entry->second.data));
+    _entries.erase(entry);
+}
@@ -0,0 +1,48 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_FILECACHE_HPP
+#define MELONDS_DS_FILECACHE_HPP
+
+#include <cstdio>
+#include <string>
+
+/// Keeps the BIOS and firmware images in memory for the life of the process,
+/// so that switching games doesn't read them from disk again.
+/// Disabled on Windows, which can't open a stream over memory.
+/// Safe to use from the loading tasks and the main thread at the same time.
+namespace melonds::filecache {
+    /// Creates the cache's lock; call before any other function.
+    void Init() noexcept;
+
+    /// True if \c name is one of the system files that should be cached (and caching is available).
+    /// \param name The file name that melonDS asked for, before it's resolved to the system directory.
+    bool IsCacheable(const std::string &name) noexcept;
+
+    /// Opens a read-only stream over the contents of the file at \c path,
+    /// reading it into the cache first if it's not already there (or if it changed on disk).
+    /// \return nullptr if the file doesn't exist or can't be cached,
+    /// in which case the caller should open it normally.
+    FILE *Open(const std::string &path) noexcept;
+
+    /// Drops \c path from the cache; call before it's opened for writing.
+    void Forget(const std::string &path) noexcept;
+
+    /// Drops everything from the cache, logs how often it was used, and frees the cache's lock.
+    void DeInit() noexcept;
+}
+
+#endif //MELONDS_DS_FILECACHE_HPP
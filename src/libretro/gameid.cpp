@@ -0,0 +1,366 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "gameid.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <encodings/crc32.h>
+#include <features/features_cpu.h>
+#include <file/archive_file.h>
+#include <file/file_path.h>
+#include <formats/logiqx_dat.h>
+#include <retro_miscellaneous.h>
+#include <streams/file_stream.h>
+#include <utils/md5.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include "environment.hpp"
+
+namespace melonds::gameid {
+    // No-Intro's names for its DS DATs; the first one found in the system directory is used
+    static const char *const DAT_NAMES[] = {
+        "Nintendo - Nintendo DS (Decrypted).dat",
+        "Nintendo - Nintendo DS.dat",
+    };
+
+    constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+    struct GameIdentity {
+        /// The four-character game code from the ROM header.
+        std::string game_code;
+
+        /// CRC32 of the entire ROM file.
+        uint32_t crc32 = 0;
+
+        /// MD5 of the entire ROM file as lowercase hex, or empty if it couldn't be computed
+        /// (e.g. for ROMs in archives, whose CRC32 comes from the archive's index).
+        std::string md5;
+
+        /// The game's name from the DAT, or empty if it's not in the DAT (or there is no DAT).
+        std::string name;
+    };
+
+    struct DatEntry {
+        std::string name;
+        std::string md5;
+    };
+
+    // Built once per session, on the first game's worker thread
+    static std::unordered_map<uint32_t, DatEntry> _dat_index;
+    static bool _dat_loaded = false;
+
+    static std::string _path;
+    static GameIdentity _identity;
+
+#ifdef HAVE_THREADS
+    static sthread_t *_worker = nullptr;
+    static slock_t *_lock = nullptr;
+    static bool _done = false;
+    static bool _cancelled = false;
+    static retro_time_t _duration = 0;
+
+    static void worker_main(void *);
+    static bool cancelled() noexcept;
+    static bool hash_file(const std::string &path, GameIdentity &identity);
+    static bool hash_archived_file(const std::string &path, GameIdentity &identity);
+    static void load_dat();
+    static bool parse_attribute(const char *line, const char *attribute, std::string &value);
+#endif
+}
+
+void melonds::gameid::Start(const char *path, const char *game_code) {
+    Stop();
+
+    if (!path || !game_code)
+        return;
+
+#ifdef HAVE_THREADS
+    _path = path;
+    _identity.game_code.assign(game_code, 4);
+    _done = false;
+    _cancelled = false;
+    _lock = slock_new();
+    if (_lock) {
+        _worker = sthread_create(worker_main, nullptr);
+    }
+
+    if (!_worker) {
+        retro::warn("Failed to start the ROM hashing thread; the game won't be identified");
+        Stop();
+    }
+#else
+    // Hashing on this thread would delay the first frame
+    retro::debug("Threads aren't available, so the game won't be identified");
+#endif
+}
+
+void melonds::gameid::Stop() {
+#ifdef HAVE_THREADS
+    if (_worker) {
+        slock_lock(_lock);
+        _cancelled = true;
+        slock_unlock(_lock);
+
+        // The worker checks for cancellation between chunks, so this won't take long
+        sthread_join(_worker);
+        _worker = nullptr;
+    }
+
+    if (_lock) {
+        slock_free(_lock);
+        _lock = nullptr;
+    }
+
+    _done = false;
+    _cancelled = false;
+#endif
+
+    _path.clear();
+    _identity = GameIdentity();
+}
+
+void melonds::gameid::DeInit() {
+    Stop();
+    _dat_index.clear();
+    _dat_loaded = false;
+}
+
+void melonds::gameid::Poll() {
+#ifdef HAVE_THREADS
+    if (!_worker)
+        return;
+
+    slock_lock(_lock);
+    bool done = _done;
+    slock_unlock(_lock);
+
+    if (!done)
+        return;
+
+    sthread_join(_worker);
+    _worker = nullptr;
+    if (_identity.crc32 == 0) {
+        retro::warn("Couldn't hash \"%s\"; the game won't be identified", _path.c_str());
+    } else if (_identity.name.empty()) {
+        retro::info(
+            "Hashed %s in %.1fms (CRC32 %08x, MD5 %s), but it's not in the DAT",
+            _identity.game_code.c_str(),
+            _duration / 1000.0,
+            _identity.crc32,
+            _identity.md5.empty() ? "unknown" : _identity.md5.c_str()
+        );
+    } else {
+        retro::info(
+            "Identified %s as \"%s\" in %.1fms (CRC32 %08x)",
+            _identity.game_code.c_str(),
+            _identity.name.c_str(),
+            _duration / 1000.0,
+            _identity.crc32
+        );
+    }
+#endif
+}
+
+#ifdef HAVE_THREADS
+static void melonds::gameid::worker_main(void *) {
+    retro_time_t start = cpu_features_get_time_usec();
+
+    // Only this thread touches _identity until _done is set
+    bool hashed = path_contains_compressed_file(_path.c_str()) ?
+        hash_archived_file(_path, _identity) :
+        hash_file(_path, _identity);
+
+    if (hashed && !cancelled()) {
+        if (!_dat_loaded) {
+            load_dat();
+            _dat_loaded = !cancelled();
+            if (!_dat_loaded) {
+                // Don't keep a partial index around; the next game will build it again
+                _dat_index.clear();
+            }
+        }
+
+        auto entry = _dat_index.find(_identity.crc32);
+        if (entry != _dat_index.end() && (_identity.md5.empty() || entry->second.md5.empty() || entry->second.md5 == _identity.md5)) {
+            // If the CRC32 matches (and the MD5 too, if we have both)...
+            _identity.name = entry->second.name;
+        }
+    }
+
+    slock_lock(_lock);
+    _duration = cpu_features_get_time_usec() - start;
+    _done = true;
+    slock_unlock(_lock);
+}
+
+static bool melonds::gameid::cancelled() noexcept {
+    slock_lock(_lock);
+    bool cancelled = _cancelled;
+    slock_unlock(_lock);
+    return cancelled;
+}
+
+// Reads the file in chunks rather than all at once, so hashing doesn't need another copy of the ROM in memory
+static bool melonds::gameid::hash_file(const std::string &path, GameIdentity &identity) {
+    RFILE *file = filestream_open(path.c_str(), RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+    if (!file)
+        return false;
+
+    std::vector<uint8_t> buffer(CHUNK_SIZE);
+    uint32_t crc = 0;
+    MD5_CTX md5;
+    MD5_Init(&md5);
+
+    int64_t read;
+    while ((read = filestream_read(file, buffer.data(), buffer.size())) > 0) {
+        if (cancelled()) {
+            filestream_close(file);
+            return false;
+        }
+
+        crc = encoding_crc32(crc, buffer.data(), read);
+        MD5_Update(&md5, buffer.data(), read);
+    }
+    filestream_close(file);
+
+    if (read < 0)
+        return false;
+
+    unsigned char digest[16];
+    MD5_Final(digest, &md5);
+
+    char hex[33];
+    for (int i = 0; i < 16; ++i) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+
+    identity.crc32 = crc;
+    identity.md5 = hex;
+    return true;
+}
+
+// Archives already store each file's CRC32, so there's no need to decompress the ROM again
+static bool melonds::gameid::hash_archived_file(const std::string &path, GameIdentity &identity) {
+    identity.crc32 = file_archive_get_file_crc32(path.c_str());
+    return identity.crc32 != 0;
+}
+
+// Only the <game name="..."> and <rom ... crc="..." md5="..."/> elements are needed,
+// and No-Intro DATs put each one on its own line
+static void melonds::gameid::load_dat() {
+    const std::optional<std::string> &system_directory = retro::get_system_directory();
+    if (!system_directory)
+        return;
+
+    char path[PATH_MAX_LENGTH];
+    bool found = false;
+    for (const char *name : DAT_NAMES) {
+        fill_pathname_join_special(path, system_directory->c_str(), name, sizeof(path));
+        uint64_t size = 0;
+        if (logiqx_dat_path_is_valid(path, &size)) {
+            found = true;
+            break;
+        }
+    }
+
+    if (!found) {
+        retro::debug("No DS DAT found in the system directory");
+        return;
+    }
+
+    RFILE *file = filestream_open(path, RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+    if (!file)
+        return;
+
+    retro_time_t start = cpu_features_get_time_usec();
+    char line[1024];
+    std::string game_name;
+    std::string crc;
+    std::string md5;
+    while (filestream_gets(file, line, sizeof(line)) && !cancelled()) {
+        if (strstr(line, "<game ")) {
+            parse_attribute(line, "name", game_name);
+        } else if (strstr(line, "<rom ") && parse_attribute(line, "crc", crc)) {
+            DatEntry &entry = _dat_index[static_cast<uint32_t>(strtoul(crc.c_str(), nullptr, 16))];
+            entry.name = game_name;
+            entry.md5 = parse_attribute(line, "md5", md5) ? md5 : std::string();
+            for (char &c : entry.md5) {
+                c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            }
+        }
+    }
+    filestream_close(file);
+
+    retro::info(
+        "Indexed %zu games from \"%s\" in %.1fms",
+        _dat_index.size(),
+        path,
+        (cpu_features_get_time_usec() - start) / 1000.0
+    );
+}
+
+static bool melonds::gameid::parse_attribute(const char *line, const char *attribute, std::string &value) {
+    std::string pattern = std::string(" ") + attribute + "=\"";
+    const char *start = strstr(line, pattern.c_str());
+    if (!start)
+        return false;
+
+    start += pattern.size();
+    const char *end = strchr(start, '"');
+    if (!end)
+        return false;
+
+    // No-Intro escapes &, <, >, " and ' in names (e.g. "Mario &amp; Luigi")
+    static const std::pair<const char *, char> ENTITIES[] = {
+        {"&amp;", '&'},
+        {"&lt;", '<'},
+        {"&gt;", '>'},
+        {"&quot;", '"'},
+        {"&apos;", '\''},
+    };
+
+    value.clear();
+    for (const char *c = start; c < end;) {
+        bool decoded = false;
+        if (*c == '&') {
+            for (const auto &[entity, replacement] : ENTITIES) {
+                size_t length = strlen(entity);
+                if (static_cast<size_t>(end - c) >= length && strncmp(c, entity, length) == 0) {
+                    value += replacement;
+                    c += length;
+                    decoded = true;
+                    break;
+                }
+            }
+        }
+
+        if (!decoded) {
+            value += *c++;
+        }
+    }
+
+    return true;
+}
+#endif
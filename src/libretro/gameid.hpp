@@ -0,0 +1,40 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_GAMEID_HPP
+#define MELONDS_DS_GAMEID_HPP
+
+/// Identifies the loaded game by hashing its ROM on a worker thread
+/// and looking the hash up in a No-Intro DAT from the system directory.
+/// The result is only logged, so that bug reports say exactly which dump was loaded.
+namespace melonds::gameid {
+    /// Starts hashing the ROM at \c path in the background. Never blocks.
+    /// Does nothing if threads aren't available.
+    /// \param game_code The game code from the ROM header, which is known without hashing anything.
+    void Start(const char *path, const char *game_code);
+
+    /// Cancels any hashing in progress and forgets the loaded game's identity.
+    void Stop();
+
+    /// Frees the DAT index; call when the core is unloaded.
+    void DeInit();
+
+    /// Checks whether the background work has finished, logging the result if so.
+    /// Call once per frame on the emulation thread. Never blocks.
+    void Poll();
+}
+
+#endif //MELONDS_DS_GAMEID_HPP
@@ -0,0 +1,239 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "gameprofile.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include <file/config_file.h>
+#include <file/file_path.h>
+#include <frontend/qt_sdl/Config.h>
+#include <retro_miscellaneous.h>
+#include <string/stdstring.h>
+
+#include "environment.hpp"
+#include "jittune.hpp"
+
+namespace melonds::gameprofile {
+    constexpr const char *PROFILE_OVERRIDE_NAME = "melondsds_profiles.cfg";
+
+    static std::string _game_code;
+    static Profile _profile;
+    static std::string _sources;
+
+    static bool apply_overrides(const std::string &game_code, Profile &profile);
+    static std::string describe(const Profile &profile);
+}
+
+bool melonds::gameprofile::Profile::Empty() const noexcept {
+    return !threaded_3d && !gl_scale_factor && !renderer && !jit_max_block_size &&
+        !jit_branch_optimisations && !jit_literal_optimisations && !jit_fast_memory;
+}
+
+void melonds::gameprofile::Load(const char *game_code) {
+    Unload();
+    if (!game_code)
+        return;
+
+    _game_code.assign(game_code, strnlen(game_code, 4));
+    for (char &c : _game_code) {
+        if (!isalnum(static_cast<unsigned char>(c)))
+            // Keep the game code usable as part of a config file key
+            c = '_';
+    }
+
+    auto add_source = [](const char *source) {
+        if (!_sources.empty())
+            _sources += " + ";
+
+        _sources += source;
+    };
+
+#ifdef JIT_ENABLED
+    if (std::optional<int> block_size = jittune::TunedBlockSize(_game_code)) {
+        _profile.jit_max_block_size = block_size;
+        add_source("auto-tuned");
+    }
+#endif
+
+    if (apply_overrides(_game_code, _profile)) {
+        add_source("local");
+    }
+}
+
+void melonds::gameprofile::Unload() noexcept {
+    _game_code.clear();
+    _profile = Profile();
+    _sources.clear();
+}
+
+const std::string &melonds::gameprofile::GameCode() noexcept {
+    return _game_code;
+}
+
+void melonds::gameprofile::Apply(bool init) {
+    if (_profile.Empty()) {
+        if (init && !_game_code.empty()) {
+            retro::debug("No performance profile for %s; using the core options as-is", _game_code.c_str());
+        }
+        return;
+    }
+
+    // check_variables re-reads these from the core options whenever any option changes,
+    // so they have to be re-applied every time or the profile would silently stop applying.
+    // The JIT settings only reach the emulator when it's next reset, so that's when they take effect.
+    if (_profile.threaded_3d)
+        Config::Threaded3D = *_profile.threaded_3d;
+
+    if (_profile.gl_scale_factor)
+        Config::GL_ScaleFactor = *_profile.gl_scale_factor;
+
+#ifdef JIT_ENABLED
+    if (_profile.jit_max_block_size)
+        Config::JIT_MaxBlockSize = *_profile.jit_max_block_size;
+
+    if (_profile.jit_branch_optimisations)
+        Config::JIT_BranchOptimisations = *_profile.jit_branch_optimisations;
+
+    if (_profile.jit_literal_optimisations)
+        Config::JIT_LiteralOptimisations = *_profile.jit_literal_optimisations;
+
+    if (_profile.jit_fast_memory)
+        Config::JIT_FastMemory = *_profile.jit_fast_memory;
+#endif
+
+    if (init) {
+        // The renderer is only read from the core options when the game is loaded,
+        // since it can't be changed while the game is running
+#ifdef HAVE_OPENGL
+        if (_profile.renderer)
+            Config::Retro::ConfiguredRenderer = *_profile.renderer;
+#endif
+
+        retro::info("Applied performance profile for %s (%s): %s", _game_code.c_str(), _sources.c_str(), describe(_profile).c_str());
+    }
+}
+
+// Reads keys like "ABCE_jit_max_block_size = 16" from the override file in the system directory
+static bool melonds::gameprofile::apply_overrides(const std::string &game_code, Profile &profile) {
+    const std::optional<std::string> &system_directory = retro::get_system_directory();
+    if (!system_directory)
+        return false;
+
+    char path[PATH_MAX_LENGTH];
+    fill_pathname_join_special(path, system_directory->c_str(), PROFILE_OVERRIDE_NAME, sizeof(path));
+    if (!path_is_valid(path))
+        return false;
+
+    config_file_t *overrides = config_file_new_from_path_to_string(path);
+    if (!overrides) {
+        retro::warn("Failed to read performance profiles from \"%s\"", path);
+        return false;
+    }
+
+    bool found = false;
+    auto key = [&game_code](const char *setting) {
+        return game_code + "_" + setting;
+    };
+
+    bool b;
+    int i;
+    if (config_get_bool(overrides, key("threaded_3d").c_str(), &b)) {
+        profile.threaded_3d = b;
+        found = true;
+    }
+
+    if (config_get_int(overrides, key("gl_scale_factor").c_str(), &i)) {
+        profile.gl_scale_factor = std::clamp(i, 1, 8);
+        found = true;
+    }
+
+    char renderer[16];
+    if (config_get_array(overrides, key("renderer").c_str(), renderer, sizeof(renderer))) {
+        if (string_is_equal(renderer, "opengl")) {
+            profile.renderer = Renderer::OpenGl;
+            found = true;
+        } else if (string_is_equal(renderer, "software")) {
+            profile.renderer = Renderer::Software;
+            found = true;
+        } else {
+            retro::warn("Ignoring unknown renderer \"%s\" for %s in \"%s\"", renderer, game_code.c_str(), path);
+        }
+    }
+
+    if (config_get_int(overrides, key("jit_max_block_size").c_str(), &i)) {
+        profile.jit_max_block_size = std::clamp(i, 1, 32);
+        found = true;
+    }
+
+    if (config_get_bool(overrides, key("jit_branch_optimisations").c_str(), &b)) {
+        profile.jit_branch_optimisations = b;
+        found = true;
+    }
+
+    if (config_get_bool(overrides, key("jit_literal_optimisations").c_str(), &b)) {
+        profile.jit_literal_optimisations = b;
+        found = true;
+    }
+
+    if (config_get_bool(overrides, key("jit_fast_memory").c_str(), &b)) {
+        profile.jit_fast_memory = b;
+        found = true;
+    }
+
+    config_file_free(overrides);
+    return found;
+}
+
+static std::string melonds::gameprofile::describe(const Profile &profile) {
+    std::string description;
+    auto append = [&description](const char *name, const std::string &value) {
+        if (!description.empty())
+            description += ", ";
+
+        description += name;
+        description += '=';
+        description += value;
+    };
+    auto boolean = [](bool value) {
+        return std::string(value ? "on" : "off");
+    };
+
+    if (profile.threaded_3d)
+        append("threaded 3D", boolean(*profile.threaded_3d));
+
+    if (profile.gl_scale_factor)
+        append("GL scale", std::to_string(*profile.gl_scale_factor));
+
+    if (profile.renderer)
+        append("renderer", *profile.renderer == Renderer::OpenGl ? "OpenGL" : "software");
+
+    if (profile.jit_max_block_size)
+        append("JIT block size", std::to_string(*profile.jit_max_block_size));
+
+    if (profile.jit_branch_optimisations)
+        append("JIT branch optimisations", boolean(*profile.jit_branch_optimisations));
+
+    if (profile.jit_literal_optimisations)
+        append("JIT literal optimisations", boolean(*profile.jit_literal_optimisations));
+
+    if (profile.jit_fast_memory)
+        append("JIT fast memory", boolean(*profile.jit_fast_memory));
+
+    return description;
+}
@@ -0,0 +1,62 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_GAMEPROFILE_HPP
+#define MELONDS_DS_GAMEPROFILE_HPP
+
+#include <optional>
+#include <string>
+
+#include "config.hpp"
+
+/// Per-game performance settings, keyed by the game code in the NDS ROM header.
+/// Each profile starts with the block size picked by JIT auto-tuning (if any),
+/// with any values in <system dir>/melondsds_profiles.cfg taking precedence.
+/// A profile's settings take precedence over the corresponding core options.
+namespace melonds::gameprofile {
+    /// Settings that aren't set leave the corresponding core option alone.
+    struct Profile {
+        std::optional<bool> threaded_3d;
+        std::optional<int> gl_scale_factor;
+        std::optional<Renderer> renderer;
+        std::optional<int> jit_max_block_size;
+        std::optional<bool> jit_branch_optimisations;
+        std::optional<bool> jit_literal_optimisations;
+        std::optional<bool> jit_fast_memory;
+
+        [[nodiscard]] bool Empty() const noexcept;
+    };
+
+    /// Looks up the profile for the game that's about to be loaded.
+    /// Must be called before check_variables(true).
+    /// \param game_code The four-character game code from the ROM header, or nullptr if it isn't known.
+    void Load(const char *game_code);
+
+    /// Forgets the loaded game's profile.
+    void Unload() noexcept;
+
+    /// Overwrites the relevant settings in \c Config with the loaded game's profile, if any.
+    /// Called by check_variables after it reads the core options.
+    /// \param init If true, the game is being loaded, so the renderer is applied too
+    /// (and the profile is logged); every other setting is re-applied on every call.
+    void Apply(bool init);
+
+    /// The loaded game's game code (with characters that can't be used in a config key replaced),
+    /// or empty if no game is loaded.
+    const std::string &GameCode() noexcept;
+}
+
+#endif //MELONDS_DS_GAMEPROFILE_HPP
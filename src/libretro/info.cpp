@@ -29,13 +29,37 @@ const struct retro_system_content_info_override melonds::content_overrides[] = {
     {
         "nds|dsi|ids|gba",
         false,
-        true
-        // We need to keep the ROM around for reloads
+        false
+        // The parsed cart keeps its own copy of the ROM (which melonDS modifies anyway),
+        // so the frontend doesn't need to keep its buffer around after retro_load_game returns
     },
     {}
 };
 
 
+const struct retro_system_content_info_override melonds::low_memory_content_overrides[] = {
+    {
+        "srm|sav",
+        true,
+        false
+        // We don't want the frontend to maintain an open handle the GBA save data,
+        // as we may want to write back changes later.
+    },
+    {
+        "nds|dsi|ids",
+        true,
+        false
+        // We map the ROM ourselves so that it doesn't have to be resident all at once
+    },
+    {
+        "gba",
+        false,
+        false
+        // GBA ROMs are small enough that mapping them isn't worth it
+    },
+    {}
+};
+
 static const struct retro_subsystem_memory_info nds_memory[] = {
     {"srm", RETRO_MEMORY_SAVE_RAM},
 };
@@ -25,7 +25,13 @@ namespace melonds {
     constexpr int MELONDSDS_GAME_TYPE_GBA = 1;
     constexpr int MELONDSDS_GAME_TYPE_SLOT_1_2_BOOT = 1;
     constexpr int MELONDSDS_MEMORY_GBA_SAVE_RAM = 0x101;
+
+    /// A SaveRamStatus (see memory.hpp) describing changes to RETRO_MEMORY_SAVE_RAM.
+    constexpr int MELONDSDS_MEMORY_SAVE_RAM_STATUS = 0x102;
     extern const struct retro_system_content_info_override content_overrides[];
+
+    /// Used instead of content_overrides if the low-memory ROM option is enabled.
+    extern const struct retro_system_content_info_override low_memory_content_overrides[];
     extern const struct retro_subsystem_info subsystems[];
     extern const struct retro_controller_description controllers[];
     extern const struct retro_controller_info ports[];
@@ -17,7 +17,9 @@
 #include "input.hpp"
 
 #include <algorithm>
+#include <iterator>
 #include <NDS.h>
+#include "config.hpp"
 #include "environment.hpp"
 #include "utils.hpp"
 #include "libretro.hpp"
@@ -26,9 +28,19 @@ namespace melonds {
 
     struct InputState input_state;
     static bool _has_touched = false;
-}
 
-const struct retro_input_descriptor melonds::input_descriptors[] = {
+    /// One of the core's own hotkeys, which isn't a DS button.
+    struct Hotkey {
+        HotkeyBinding binding;
+
+        /// The key that the hotkey uses if it's bound to the keyboard.
+        unsigned keyboard_key;
+
+        /// Shown in the frontend's controls menu if the hotkey is bound to a joypad button.
+        const char *description;
+    };
+
+    static const struct retro_input_descriptor BASE_INPUT_DESCRIPTORS[] = {
         {0, RETRO_DEVICE_JOYPAD, 0,                               RETRO_DEVICE_ID_JOYPAD_LEFT,   "Left"},
         {0, RETRO_DEVICE_JOYPAD, 0,                               RETRO_DEVICE_ID_JOYPAD_UP,     "Up"},
         {0, RETRO_DEVICE_JOYPAD, 0,                               RETRO_DEVICE_ID_JOYPAD_DOWN,   "Down"},
@@ -48,7 +60,76 @@ const struct retro_input_descriptor melonds::input_descriptors[] = {
         {0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_RIGHT, RETRO_DEVICE_ID_ANALOG_X,      "Touch joystick X"},
         {0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_RIGHT, RETRO_DEVICE_ID_ANALOG_Y,      "Touch joystick Y"},
         {0},
-};
+    };
+
+    // Refreshed from the config by update_hotkeys
+    static Hotkey _rewind_hotkey {HotkeyBinding::Keyboard, RETROK_BACKSPACE, "Rewind"};
+    static Hotkey _quick_save_hotkey {HotkeyBinding::Keyboard, RETROK_PAGEUP, "Quick save"};
+    static Hotkey _quick_load_hotkey {HotkeyBinding::Keyboard, RETROK_PAGEDOWN, "Quick load"};
+    static Hotkey *const HOTKEYS[] = {&_rewind_hotkey, &_quick_save_hotkey, &_quick_load_hotkey};
+
+    static void update_hotkeys() noexcept;
+    static int joypad_button(HotkeyBinding binding) noexcept;
+    static const Hotkey *hotkey_on_button(unsigned id) noexcept;
+    static bool hotkey_pressed(const Hotkey &hotkey, uint32_t joypad_bits) noexcept;
+}
+
+void melonds::set_input_descriptors() {
+    static struct retro_input_descriptor descriptors[std::size(BASE_INPUT_DESCRIPTORS)];
+
+    update_hotkeys();
+    std::copy(std::begin(BASE_INPUT_DESCRIPTORS), std::end(BASE_INPUT_DESCRIPTORS), descriptors);
+    for (retro_input_descriptor &descriptor : descriptors) {
+        if (descriptor.description && descriptor.device == RETRO_DEVICE_JOYPAD) {
+            if (const Hotkey *hotkey = hotkey_on_button(descriptor.id))
+                // If one of our hotkeys took over this button...
+                descriptor.description = hotkey->description;
+        }
+    }
+
+    retro::environment(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, descriptors);
+}
+
+static void melonds::update_hotkeys() noexcept {
+    _rewind_hotkey.binding = Config::Retro::RewindButton;
+    _quick_save_hotkey.binding = Config::Retro::QuickSaveButton;
+    _quick_load_hotkey.binding = Config::Retro::QuickLoadButton;
+}
+
+// Returns the RETRO_DEVICE_ID_JOYPAD_* that binding refers to, or -1 if it's not a joypad button
+static int melonds::joypad_button(HotkeyBinding binding) noexcept {
+    switch (binding) {
+        case HotkeyBinding::L2:
+            return RETRO_DEVICE_ID_JOYPAD_L2;
+        case HotkeyBinding::R2:
+            return RETRO_DEVICE_ID_JOYPAD_R2;
+        case HotkeyBinding::L3:
+            return RETRO_DEVICE_ID_JOYPAD_L3;
+        case HotkeyBinding::R3:
+            return RETRO_DEVICE_ID_JOYPAD_R3;
+        default:
+            return -1;
+    }
+}
+
+static const melonds::Hotkey *melonds::hotkey_on_button(unsigned id) noexcept {
+    for (const Hotkey *hotkey : HOTKEYS) {
+        if (joypad_button(hotkey->binding) == static_cast<int>(id))
+            return hotkey;
+    }
+
+    return nullptr;
+}
+
+static bool melonds::hotkey_pressed(const Hotkey &hotkey, uint32_t joypad_bits) noexcept {
+    if (hotkey.binding == HotkeyBinding::Disabled)
+        return false;
+
+    if (hotkey.binding == HotkeyBinding::Keyboard)
+        return retro::input_state(0, RETRO_DEVICE_KEYBOARD, 0, hotkey.keyboard_key);
+
+    return joypad_bits & (1 << joypad_button(hotkey.binding));
+}
 
 static const char *device_name(unsigned device) {
     switch (device) {
@@ -117,7 +198,11 @@ void melonds::update_input(InputState &state) {
 
     NDS::SetKeyMask(input_mask);
 
-    bool lid_closed_btn = retro::input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L3);
+    update_hotkeys();
+
+    // Buttons that one of our hotkeys took over don't do their usual jobs
+    bool lid_closed_btn = !hotkey_on_button(RETRO_DEVICE_ID_JOYPAD_L3) &&
+                          retro::input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L3);
     if (lid_closed_btn != state.lid_closed) {
         NDS::SetLidClosed(lid_closed_btn);
         state.lid_closed = lid_closed_btn;
@@ -125,22 +210,16 @@ void melonds::update_input(InputState &state) {
     }
 
     state.previous_holding_noise_btn = state.holding_noise_btn;
-    state.holding_noise_btn = retro::input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L2);
-    state.swap_screens_btn = retro::input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R2);
-
-//    if (micNoiseType == MicInput && // If the player wants to use their real mic...
-//        noise_button_required && // ...and they don't always want it hot...
-//        (state.holding_noise_btn != state.previous_holding_noise_btn) &&
-//        // ...and they just pressed or released the button...
-//        micHandle != NULL && micInterface.interface_version > 0 // ...and the mic is valid...
-//            ) {
-//        bool stateSet = micInterface.set_mic_state(micHandle, state.holding_noise_btn);
-//        // ...then set the state of the mic to the active staste of the noise button
-//
-//        if (!stateSet)
-//            retro::log(RETRO_LOG_ERROR, "[melonDS] Error setting state of microphone to %s\n",
-//                   state.holding_noise_btn ? "enabled" : "disabled");
-//    }
+    state.holding_noise_btn = !hotkey_on_button(RETRO_DEVICE_ID_JOYPAD_L2) &&
+                              retro::input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L2);
+    state.swap_screens_btn = !hotkey_on_button(RETRO_DEVICE_ID_JOYPAD_R2) &&
+                             retro::input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R2);
+
+    state.rewind_btn = hotkey_pressed(_rewind_hotkey, joypad_bits);
+    state.previous_quick_save_btn = state.quick_save_btn;
+    state.quick_save_btn = hotkey_pressed(_quick_save_hotkey, joypad_bits);
+    state.previous_quick_load_btn = state.quick_load_btn;
+    state.quick_load_btn = hotkey_pressed(_quick_load_hotkey, joypad_bits);
 
     if (current_screen_layout() != ScreenLayout::TopOnly) {
         switch (state.current_touch_mode) {
@@ -201,7 +280,8 @@ void melonds::update_input(InputState &state) {
                 state.touch_x = std::clamp(state.touch_x + joystick_x, 0, melonds::VIDEO_WIDTH - 1);
                 state.touch_y = std::clamp(state.touch_y + joystick_y, 0, melonds::VIDEO_HEIGHT - 1);
 
-                state.touching = retro::input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R3);
+                state.touching = !hotkey_on_button(RETRO_DEVICE_ID_JOYPAD_R3) &&
+                                 retro::input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R3);
 
                 break;
         }
@@ -21,7 +21,9 @@
 
 namespace melonds {
 
-    extern const struct retro_input_descriptor input_descriptors[];
+    /// Describes the joypad to the frontend, including any buttons that the core's hotkeys have taken over.
+    /// Call again whenever the hotkey bindings change.
+    void set_input_descriptors();
 
     enum class TouchMode {
         Disabled,
@@ -40,6 +42,11 @@ namespace melonds {
         bool holding_noise_btn = false;
         bool swap_screens_btn = false;
         bool lid_closed = false;
+        bool rewind_btn = false;
+        bool previous_quick_save_btn = false;
+        bool quick_save_btn = false;
+        bool previous_quick_load_btn = false;
+        bool quick_load_btn = false;
 
         [[nodiscard]] bool cursor_enabled() const;
     };
@@ -50,6 +57,8 @@ namespace melonds {
         HostMic,
         WhiteNoise,
         BlowNoise,
+        Tone,
+        File,
     };
 
     extern InputState input_state;
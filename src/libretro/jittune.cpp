@@ -0,0 +1,288 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "jittune.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <file/config_file.h>
+#include <file/file_path.h>
+#include <retro_miscellaneous.h>
+#include <frontend/qt_sdl/Config.h>
+#ifdef JIT_ENABLED
+#include <ARMJIT.h>
+#endif
+
+#include "config.hpp"
+#include "environment.hpp"
+#include "gameprofile.hpp"
+
+namespace melonds::jittune {
+    constexpr const char *JIT_TUNING_NAME = "melondsds_jit_tuning.cfg";
+    constexpr int CANDIDATES[] = {1, 4, 8, 12, 16, 24, 32};
+
+    // Frames to skip after switching block sizes, while the block cache refills
+    constexpr unsigned WARMUP_FRAMES = 10;
+    constexpr unsigned WINDOW_FRAMES = 60;
+    constexpr unsigned ROUNDS = 4;
+
+    // A window whose 90th-percentile frame took this much longer than its median
+    // probably included a loading screen or some other hitch, so it's not used
+    constexpr double MAX_WINDOW_SPREAD = 1.5;
+
+    struct Candidate {
+        int block_size;
+        std::vector<retro_time_t> samples;
+        unsigned stable_windows = 0;
+    };
+
+    static bool _active = false;
+    static std::string _game_code;
+    static int _original_block_size = 0;
+    static std::vector<Candidate> _candidates;
+    static size_t _current = 0;
+    static unsigned _round = 0;
+    static unsigned _warmup = 0;
+    static std::vector<retro_time_t> _window;
+
+    static std::optional<std::string> tuning_path();
+    static void switch_to(int block_size);
+    static void finish_window();
+    static void finish();
+    static retro_time_t percentile(std::vector<retro_time_t> samples, double p);
+}
+
+void melonds::jittune::Init() {
+    DeInit();
+
+#ifdef JIT_ENABLED
+    if (!Config::Retro::JitAutoTune || !Config::JIT_Enable)
+        return;
+
+    std::string game_code = gameprofile::GameCode();
+    if (game_code.empty())
+        return;
+
+    if (TunedBlockSize(game_code)) {
+        retro::debug("%s already has a tuned JIT block size; not tuning it again", game_code.c_str());
+        return;
+    }
+
+    if (!tuning_path()) {
+        retro::warn("No save directory, so the JIT block size can't be tuned");
+        return;
+    }
+
+    _candidates.clear();
+    for (int block_size : CANDIDATES) {
+        Candidate candidate;
+        candidate.block_size = block_size;
+        _candidates.push_back(candidate);
+    }
+
+    // Tuning only ever touches the JIT's own copy of the setting, so Config keeps what the player and profile chose
+    _original_block_size = ARMJIT::MaxBlockSize;
+    _game_code = game_code;
+    _current = 0;
+    _round = 0;
+    _active = true;
+    switch_to(_candidates[_current].block_size);
+
+    retro::info(
+        "Tuning the JIT block size for %s over the next %zu frames",
+        _game_code.c_str(),
+        _candidates.size() * ROUNDS * (WARMUP_FRAMES + WINDOW_FRAMES)
+    );
+#endif
+}
+
+void melonds::jittune::DeInit() {
+#ifdef JIT_ENABLED
+    if (_active) {
+        // The next NDS::Reset would reload it from Config anyway, but the emulator may keep running until then
+        ARMJIT::MaxBlockSize = _original_block_size;
+        retro::info("JIT block size tuning for %s didn't finish; it'll start over next time", _game_code.c_str());
+    }
+#endif
+
+    _active = false;
+    _game_code.clear();
+    _candidates.clear();
+    _window.clear();
+}
+
+void melonds::jittune::Reset() {
+#ifdef JIT_ENABLED
+    if (_game_code.empty())
+        return;
+
+    if (_active) {
+        // NDS::Reset reloaded the configured block size, so the current candidate has to be applied again
+        switch_to(_candidates[_current].block_size);
+    } else if (std::optional<int> tuned = TunedBlockSize(_game_code)) {
+        // If tuning finished this session, keep using its pick until the game is reloaded with it in the profile
+        ARMJIT::MaxBlockSize = *tuned;
+        ARMJIT::ResetBlockCache();
+    }
+#endif
+}
+
+void melonds::jittune::RecordFrame(retro_time_t duration) {
+    if (!_active)
+        return;
+
+    if (_warmup > 0) {
+        _warmup--;
+        return;
+    }
+
+    _window.push_back(duration);
+    if (_window.size() >= WINDOW_FRAMES) {
+        finish_window();
+    }
+}
+
+std::optional<int> melonds::jittune::TunedBlockSize(const std::string &game_code) {
+    std::optional<std::string> path = tuning_path();
+    if (!path || game_code.empty() || !path_is_valid(path->c_str()))
+        return std::nullopt;
+
+    config_file_t *tuning = config_file_new_from_path_to_string(path->c_str());
+    if (!tuning)
+        return std::nullopt;
+
+    std::string key = game_code + "_jit_max_block_size";
+    int block_size = 0;
+    bool found = config_get_int(tuning, key.c_str(), &block_size);
+    config_file_free(tuning);
+
+    if (!found || block_size < 1 || block_size > 32)
+        return std::nullopt;
+
+    return block_size;
+}
+
+static std::optional<std::string> melonds::jittune::tuning_path() {
+    const std::optional<std::string> &save_directory = retro::get_save_directory();
+    if (!save_directory)
+        return std::nullopt;
+
+    char path[PATH_MAX_LENGTH];
+    fill_pathname_join_special(path, save_directory->c_str(), JIT_TUNING_NAME, sizeof(path));
+    return std::string(path);
+}
+
+// The block size can change between frames;
+// the compiled blocks are thrown out so that the new size applies everywhere
+static void melonds::jittune::switch_to([[maybe_unused]] int block_size) {
+#ifdef JIT_ENABLED
+    ARMJIT::MaxBlockSize = block_size;
+    ARMJIT::ResetBlockCache();
+#endif
+    _warmup = WARMUP_FRAMES;
+    _window.clear();
+}
+
+static void melonds::jittune::finish_window() {
+    Candidate &candidate = _candidates[_current];
+    retro_time_t median = percentile(_window, 0.5);
+    retro_time_t p90 = percentile(_window, 0.9);
+
+    if (median > 0 && p90 <= median * MAX_WINDOW_SPREAD) {
+        candidate.samples.insert(candidate.samples.end(), _window.begin(), _window.end());
+        candidate.stable_windows++;
+    }
+
+    _current++;
+    if (_current >= _candidates.size()) {
+        _current = 0;
+        _round++;
+    }
+
+    if (_round >= ROUNDS) {
+        finish();
+    } else {
+        switch_to(_candidates[_current].block_size);
+    }
+}
+
+static void melonds::jittune::finish() {
+    _active = false;
+
+    retro::info("JIT block size tuning for %s (%u windows of %u frames each):", _game_code.c_str(), ROUNDS, WINDOW_FRAMES);
+    const Candidate *best = nullptr;
+    retro_time_t best_median = 0;
+    for (const Candidate &candidate : _candidates) {
+        if (candidate.samples.empty()) {
+            retro::info("  block size %2d: no stable windows", candidate.block_size);
+            continue;
+        }
+
+        retro_time_t median = percentile(candidate.samples, 0.5);
+        retro::info(
+            "  block size %2d: median %.2fms, p90 %.2fms, %u/%u stable windows",
+            candidate.block_size,
+            median / 1000.0,
+            percentile(candidate.samples, 0.9) / 1000.0,
+            candidate.stable_windows,
+            ROUNDS
+        );
+
+        // Candidates that were only measured once or twice could've just gotten lucky
+        if (candidate.stable_windows * 2 >= ROUNDS && (!best || median < best_median)) {
+            best = &candidate;
+            best_median = median;
+        }
+    }
+
+    if (!best) {
+        retro::warn("No JIT block size ran steadily enough to pick one; keeping %d", _original_block_size);
+        switch_to(_original_block_size);
+        return;
+    }
+
+    retro::info("Picked JIT block size %d for %s", best->block_size, _game_code.c_str());
+    switch_to(best->block_size);
+
+    std::optional<std::string> path = tuning_path();
+    if (!path)
+        return;
+
+    config_file_t *tuning = path_is_valid(path->c_str()) ? config_file_new_from_path_to_string(path->c_str()) : nullptr;
+    if (!tuning) {
+        tuning = config_file_new_alloc();
+    }
+
+    if (!tuning)
+        return;
+
+    std::string key = _game_code + "_jit_max_block_size";
+    config_set_int(tuning, key.c_str(), best->block_size);
+    if (!config_file_write(tuning, path->c_str(), true)) {
+        retro::warn("Failed to write the tuned JIT block size to \"%s\"", path->c_str());
+    }
+    config_file_free(tuning);
+}
+
+static retro_time_t melonds::jittune::percentile(std::vector<retro_time_t> samples, double p) {
+    if (samples.empty())
+        return 0;
+
+    auto nth = samples.begin() + static_cast<ptrdiff_t>(p * (samples.size() - 1));
+    std::nth_element(samples.begin(), nth, samples.end());
+    return *nth;
+}
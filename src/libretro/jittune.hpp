@@ -0,0 +1,49 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_JITTUNE_HPP
+#define MELONDS_DS_JITTUNE_HPP
+
+#include <optional>
+#include <string>
+
+#include <libretro.h>
+
+/// Finds the fastest JIT block size for the loaded game by trying several during normal play.
+/// The candidates take turns in short windows, so that no candidate is measured only on an easy (or hard) scene.
+/// The winner is saved to the save directory and applied through the game's performance profile from then on.
+namespace melonds::jittune {
+    /// Starts tuning if it's enabled, the JIT is enabled, and the loaded game hasn't been tuned yet.
+    /// Call once the game has booted.
+    void Init();
+
+    /// Stops tuning. If it hasn't finished, the results so far are discarded
+    /// and the configured block size is restored.
+    void DeInit();
+
+    /// Re-applies the block size being measured (or the one tuning picked) after the console is reset,
+    /// since NDS::Reset reloads the configured block size.
+    void Reset();
+
+    /// Records how long the emulator took to run a frame, switching to the next candidate when a window is full.
+    /// Does nothing if tuning isn't active.
+    void RecordFrame(retro_time_t duration);
+
+    /// The block size that tuning picked for \c game_code in an earlier session, if any.
+    std::optional<int> TunedBlockSize(const std::string &game_code);
+}
+
+#endif //MELONDS_DS_JITTUNE_HPP
@@ -22,6 +22,7 @@
 #include <memory>
 
 #include <compat/strl.h>
+#include <features/features_cpu.h>
 #include <file/file_path.h>
 #include <libretro.h>
 #include <streams/rzip_stream.h>
@@ -37,6 +38,8 @@
 #include <GBACart.h>
 #include <retro_assert.h>
 
+#include "audio.hpp"
+#include "bootsnapshot.hpp"
 #include "opengl.hpp"
 #include "content.hpp"
 #include "environment.hpp"
@@ -45,9 +48,21 @@
 #include "utils.hpp"
 #include "info.hpp"
 #include "screenlayout.hpp"
+#include "mappedfile.hpp"
 #include "memory.hpp"
+#include "memstats.hpp"
+#include "mic.hpp"
+#include "quicksave.hpp"
+#include "rewind.hpp"
+#include "savewriter.hpp"
+#include "task.hpp"
+#include "profiler.hpp"
 #include "render.hpp"
 #include "exceptions.hpp"
+#include "filecache.hpp"
+#include "gameid.hpp"
+#include "gameprofile.hpp"
+#include "jittune.hpp"
 
 using std::optional;
 using std::nullopt;
@@ -58,7 +73,30 @@ using GBACart::GBACartData;
 namespace melonds {
     static bool swap_screen_toggled = false;
     static bool deferred_initialization_pending = false;
+
+    /// The configuration of the emulator that retro_unload_game left running, if any.
+    /// Loading another game with the same configuration reuses it instead of calling NDS::Init again.
+    struct WarmEmulator {
+        bool alive = false;
+        int console_type = 0;
+        Renderer renderer = Renderer::None;
+#ifdef JIT_ENABLED
+        bool jit_enable = false;
+        bool jit_fast_memory = false;
+#endif
+    };
+    static WarmEmulator _warm_emulator;
+
+    // True between a successful NDS::Init and the matching NDS::DeInit,
+    // whether or not the emulator is running a game (or waiting in _warm_emulator for the next one)
+    static bool _emulator_initialized = false;
+
+    // True if the current game reused the previous game's emulator
+    static bool _warm_start = false;
     static bool first_frame_run = false;
+
+    // If true, the GBA save file was rzip-compressed when we loaded it, so it's written back that way
+    static bool _gba_save_compressed = false;
     static std::unique_ptr<NDSCartData> _loaded_nds_cart;
     static std::unique_ptr<GBACartData> _loaded_gba_cart;
     static const char *const INTERNAL_ERROR_MESSAGE =
@@ -77,11 +115,17 @@ namespace melonds {
         const optional<retro_game_info> &gba_save_info
     );
     static void init_firmware_overrides();
+    static std::string peek_game_code(const struct retro_game_info &info);
+    static bool reuse_warm_emulator() noexcept;
+    static void keep_emulator_warm() noexcept;
+    static void shut_down_emulator() noexcept;
+    static void discard_failed_load() noexcept;
     static void parse_nds_rom(const struct retro_game_info &info);
+    static void parse_nds_rom_from_path(const char *path);
     static void init_nds_save(const NDSCartData &nds_cart);
     static void parse_gba_rom(const struct retro_game_info &info);
     static void init_gba_save(GBACartData &gba_cart, const struct retro_game_info& gba_save_info);
-    static void init_bios();
+    static bool find_bios();
     static void init_rendering();
     static void load_games_deferred(
         const optional<retro_game_info>& nds_info,
@@ -95,7 +139,6 @@ namespace melonds {
 
     // functions for running games
     static void render_frame();
-    static void render_audio();
     static void flush_save_data() noexcept;
     static void flush_gba_sram(const retro_game_info& gba_save_info) noexcept;
 }
@@ -110,6 +153,8 @@ PUBLIC_SYMBOL void retro_init(void) {
     srand(time(nullptr));
 
     Platform::Init(0, nullptr);
+    melonds::filecache::Init();
+    melonds::profiler::Init();
     melonds::first_frame_run = false;
     // ScreenLayoutData is initialized in its constructor
 }
@@ -148,10 +193,28 @@ static bool melonds::handle_load_game(unsigned type, const struct retro_game_inf
     }
 
     // ...then load the game.
-    melonds::load_games(
-        retro::content::get_loaded_nds_info(),
-        retro::content::get_loaded_gba_info(),
-        retro::content::get_loaded_gba_save_info()
+    retro_time_t load_start = cpu_features_get_time_usec();
+    size_t rss_before = ResidentBytes();
+    profiler::Begin();
+    {
+        profiler::Phase phase("load_games");
+        melonds::load_games(
+            retro::content::get_loaded_nds_info(),
+            retro::content::get_loaded_gba_info(),
+            retro::content::get_loaded_gba_save_info()
+        );
+    }
+
+    // The carts have their own copies of the ROMs now
+    retro::content::release_data();
+
+    retro::info(
+        "Loaded content (%s start) in %.1fms; resident memory went from %zuKiB to %zuKiB (peak %zuKiB)",
+        _warm_start ? "warm" : "cold",
+        (cpu_features_get_time_usec() - load_start) / 1000.0,
+        rss_before / 1024,
+        ResidentBytes() / 1024,
+        PeakResidentBytes() / 1024
     );
 
     return true;
@@ -159,21 +222,18 @@ static bool melonds::handle_load_game(unsigned type, const struct retro_game_inf
 catch (const melonds::invalid_rom_exception &e) {
     // Thrown for invalid ROMs
     retro::set_error_message(e.what());
-    _loaded_nds_cart.reset();
-    _loaded_gba_cart.reset();
+    discard_failed_load();
     return false;
 }
 catch (const std::exception &e) {
     retro::log(RETRO_LOG_ERROR, "%s", e.what());
     retro::set_error_message(melonds::INTERNAL_ERROR_MESSAGE);
-    _loaded_nds_cart.reset();
-    _loaded_gba_cart.reset();
+    discard_failed_load();
     return false;
 }
 catch (...) {
     retro::set_error_message(melonds::UNKNOWN_ERROR_MESSAGE);
-    _loaded_nds_cart.reset();
-    _loaded_gba_cart.reset();
+    discard_failed_load();
     return false;
 }
 
@@ -190,7 +250,8 @@ static void melonds::install_sram(
     // Nintendo DS SRAM is loaded by the frontend
     // and copied into NdsSaveManager via the pointer returned by retro_get_memory.
     // This is where we install the SRAM data into the emulated DS.
-    if (nds_info && melonds::NdsSaveManager->SramLength() > 0) {
+    // (With Fast SRAM, the frontend already loaded it directly into the cart.)
+    if (nds_info && !melonds::fast_sram_active() && melonds::NdsSaveManager->SramLength() > 0) {
         // If we're loading a NDS game that has SRAM...
         NDS::LoadSave(melonds::NdsSaveManager->Sram(), melonds::NdsSaveManager->SramLength());
     }
@@ -240,13 +301,24 @@ static void melonds::flush_gba_sram(const retro_game_info& gba_save_info) noexce
         return; // TODO: Report this error
     }
 
-    if (!filestream_write_file(save_data_path, gba_sram, gba_sram_length)) {
-        retro::error("Failed to write %u-byte GBA SRAM to \"%s\"", gba_sram_length, save_data_path);
-        // TODO: Report this to the user
+    if (!GbaSaveManager->Dirty()) {
+        // If nothing was written since the last flush (e.g. the game rewrote identical data)...
+        return;
     }
-    else {
-        retro::debug("Flushed %u-byte GBA SRAM to \"%s\"", gba_sram_length, save_data_path);
+
+    // Only the bytes that changed are copied here; the disk is touched on another thread
+    const SaveRamStatus &status = GbaSaveManager->Status();
+    for (u32 i = 0; i < status.range_count; ++i) {
+        savewriter::Submit(
+            save_data_path,
+            gba_sram,
+            gba_sram_length,
+            status.ranges[i].start,
+            status.ranges[i].end,
+            _gba_save_compressed
+        );
     }
+    GbaSaveManager->Acknowledge();
 }
 
 PUBLIC_SYMBOL void retro_run(void) {
@@ -257,6 +329,7 @@ PUBLIC_SYMBOL void retro_run(void) {
     if (deferred_initialization_pending) {
         try {
             log(RETRO_LOG_DEBUG, "Starting deferred initialization");
+            profiler::Phase phase("load_games_deferred");
             melonds::load_games_deferred(
                 retro::content::get_loaded_nds_info(),
                 retro::content::get_loaded_gba_info()
@@ -278,6 +351,7 @@ PUBLIC_SYMBOL void retro_run(void) {
         // we need to do this in the first frame of retro_run because
         // retro_get_memory_data is used to copy the loaded SRAM
         // in between retro_load and the first retro_run call.
+        profiler::Phase phase("install_sram");
         install_sram(
             retro::content::get_loaded_nds_info(),
             retro::content::get_loaded_gba_info()
@@ -325,47 +399,63 @@ PUBLIC_SYMBOL void retro_run(void) {
         mic_input_mode = melonds::MicInputMode::None;
     }
 
-    switch (mic_input_mode) {
-        case MicInputMode::WhiteNoise: // random noise
-        {
-            s16 tmp[735];
-            for (int i = 0; i < 735; i++) tmp[i] = rand() & 0xFFFF;
-            NDS::MicInputFrame(tmp, 735);
-            break;
-        }
-        case MicInputMode::BlowNoise: // blow noise
-        {
-            Frontend::Mic_FeedNoise(); // despite the name, this feeds a blow noise
-            break;
-        }
-        case MicInputMode::HostMic: // microphone input
-        {
-            s16 tmp[735];
-//                if (micHandle && micInterface.interface_version &&
-//                    micInterface.get_mic_state(micHandle)) { // If the microphone is enabled and supported...
-//                    micInterface.read_mic(micHandle, tmp, 735);
-//                    NDS::MicInputFrame(tmp, 735);
-//                    break;
-//                } // If the mic isn't available, go to the default case
-        }
-        default:
-            Frontend::Mic_FeedSilence();
-    }
+    // Only listen to the host mic while it's actually needed
+    melonds::mic::SetActive(mic_input_mode == MicInputMode::HostMic);
+
+    melonds::mic::Feed(mic_input_mode);
 
     if (melonds::render::ReadyToRender()) { // If the global state needed for rendering is ready...
+        if (input_state.quick_load_btn && !input_state.previous_quick_load_btn) {
+            melonds::quicksave::Load();
+        }
+
+        bool rewinding = input_state.rewind_btn && melonds::rewind::StepBack();
+
         // NDS::RunFrame invokes rendering-related code
+        retro_time_t frame_start = cpu_features_get_time_usec();
         NDS::RunFrame();
+        if (!rewinding) {
+            // Frames that restore a state first aren't representative
+            melonds::jittune::RecordFrame(cpu_features_get_time_usec() - frame_start);
+        }
+        melonds::bootsnapshot::Update();
+
+        if (!rewinding) {
+            // Don't record the frames we're stepping back through
+            melonds::rewind::Snapshot();
+        }
 
         // TODO: Use RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE
-        melonds::render_frame();
-        melonds::render_audio();
+        if (Config::Retro::LowLatencyAudio) {
+            // If we want the audio out the door as soon as possible,
+            // don't make it wait for the frame to be rendered and submitted
+            melonds::audio::RenderAudio(frame_start);
+            melonds::render_frame();
+        } else {
+            melonds::render_frame();
+            melonds::audio::RenderAudio(frame_start);
+        }
         melonds::flush_save_data();
+
+        // Includes any deferred initialization and the frontend's work between retro_load_game and retro_run;
+        // does nothing after the first frame
+        profiler::Finish();
+
+        if (input_state.quick_save_btn && !input_state.previous_quick_save_btn) {
+            // Captured after the frame so that the thumbnail matches the state
+            melonds::quicksave::Save();
+        }
+        melonds::quicksave::Update();
+        melonds::gameid::Poll();
     }
 
     bool updated = false;
     if (retro::environment(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated) {
         melonds::check_variables(false);
 
+        // In case a hotkey was moved to a different button
+        melonds::set_input_descriptors();
+
         struct retro_system_av_info updated_av_info{};
         retro_get_system_av_info(&updated_av_info);
         retro::environment(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &updated_av_info);
@@ -387,15 +477,6 @@ static void melonds::render_frame() {
     }
 }
 
-static void melonds::render_audio() {
-    static int16_t audio_buffer[0x1000]; // 4096 samples == 2048 stereo frames
-    u32 size = std::min(SPU::GetOutputSize(), static_cast<int>(sizeof(audio_buffer) / (2 * sizeof(int16_t))));
-    // Ensure that we don't overrun the buffer
-
-    size_t read = SPU::ReadOutput(audio_buffer, size);
-    retro::audio_sample_batch(audio_buffer, read);
-}
-
 PUBLIC_SYMBOL void retro_unload_game(void) {
     retro::log(RETRO_LOG_DEBUG, "retro_unload_game()");
     // No need to flush SRAM to the buffer, Platform::WriteNDSSave has been doing that for us this whole time
@@ -404,8 +485,18 @@ PUBLIC_SYMBOL void retro_unload_game(void) {
     if (gba_save_info) {
         melonds::flush_gba_sram(*gba_save_info);
     }
+    // Waits for the GBA SRAM to reach the disk
+    melonds::savewriter::DeInit();
+    melonds::audio::DeInit();
+    melonds::mic::DeInit();
+    melonds::rewind::DeInit();
+    melonds::quicksave::DeInit();
+    melonds::bootsnapshot::DeInit();
+    melonds::gameid::Stop();
+    melonds::jittune::DeInit();
+    melonds::gameprofile::Unload();
     NDS::Stop();
-    NDS::DeInit();
+    melonds::keep_emulator_warm();
     melonds::_loaded_nds_cart.reset();
     melonds::_loaded_gba_cart.reset();
 }
@@ -427,6 +518,10 @@ PUBLIC_SYMBOL void retro_deinit(void) {
     melonds::clear_memory_config();
     melonds::_loaded_nds_cart.reset();
     melonds::_loaded_gba_cart.reset();
+    // If the last game's emulator was kept around for a game that never came...
+    melonds::shut_down_emulator();
+    melonds::filecache::DeInit();
+    melonds::gameid::DeInit();
     Platform::DeInit();
 }
 
@@ -444,21 +539,41 @@ PUBLIC_SYMBOL void retro_get_system_info(struct retro_system_info *info) {
 
 PUBLIC_SYMBOL void retro_reset(void) {
     retro::log(RETRO_LOG_DEBUG, "retro_reset()\n");
-    NDS::Reset();
+    retro_time_t start = cpu_features_get_time_usec();
+    bool restored = melonds::bootsnapshot::Reset();
+    if (!restored) {
+        NDS::Reset();
+    }
+    melonds::jittune::Reset();
+    melonds::rewind::Clear();
 
     melonds::first_frame_run = false;
 
     const auto &nds_info = retro::content::get_loaded_nds_info();
-    if (nds_info) {
+    if (nds_info && !restored) {
         melonds::set_up_direct_boot(nds_info.value());
+        // In case the BIOS hadn't finished booting the first time, or the snapshot was rejected
+        melonds::bootsnapshot::Capture();
     }
+
+    retro::debug(
+        "Reset %s in %.1fms",
+        restored ? "from boot snapshot" : "normally",
+        (cpu_features_get_time_usec() - start) / 1000.0
+    );
 }
 
 static void melonds::parse_nds_rom(const struct retro_game_info &info) {
-    _loaded_nds_cart = std::make_unique<NDSCartData>(
-        static_cast<const u8 *>(info.data),
-        static_cast<u32>(info.size)
-    );
+    if (info.data) {
+        // If the frontend loaded the ROM for us...
+        _loaded_nds_cart = std::make_unique<NDSCartData>(
+            static_cast<const u8 *>(info.data),
+            static_cast<u32>(info.size)
+        );
+    } else {
+        // ...otherwise we're in low-memory mode, and we only got a path.
+        parse_nds_rom_from_path(info.path);
+    }
 
     if (!_loaded_nds_cart->IsValid()) {
         throw invalid_rom_exception("Failed to parse the DS ROM image. Is it valid?");
@@ -467,6 +582,40 @@ static void melonds::parse_nds_rom(const struct retro_game_info &info) {
     retro::log(RETRO_LOG_DEBUG, "Loaded NDS ROM: \"%s\"", info.path);
 }
 
+// Maps the ROM instead of reading it,
+// so its pages are read in as the cart copies them and can be reclaimed as soon as they're copied.
+static void melonds::parse_nds_rom_from_path(const char *path) {
+    if (!path) {
+        throw std::runtime_error("The frontend provided neither the DS ROM's data nor its path");
+    }
+
+    std::unique_ptr<MappedFile> rom = MappedFile::Open(path);
+    if (rom) {
+        if (rom->Size() > UINT32_MAX) {
+            throw invalid_rom_exception("The DS ROM image is too large. Is it valid?");
+        }
+
+        _loaded_nds_cart = std::make_unique<NDSCartData>(rom->Data(), static_cast<u32>(rom->Size()));
+        retro::info(
+            "Mapped %zu-byte DS ROM; %zuKiB of it was resident after parsing",
+            rom->Size(),
+            rom->ResidentBytes() / 1024
+        );
+        return;
+    }
+
+    // If the ROM couldn't be mapped (e.g. it's only reachable through the frontend's VFS)...
+    retro::warn("Failed to map \"%s\", reading it into memory instead", path);
+    void *data = nullptr;
+    int64_t size = 0;
+    if (!filestream_read_file(path, &data, &size) || !data) {
+        throw invalid_rom_exception("Failed to read the DS ROM image.");
+    }
+
+    _loaded_nds_cart = std::make_unique<NDSCartData>(static_cast<const u8 *>(data), static_cast<u32>(size));
+    free(data);
+}
+
 static void melonds::parse_gba_rom(const struct retro_game_info &info) {
     _loaded_gba_cart = std::make_unique<GBACartData>(
         static_cast<const u8 *>(info.data),
@@ -488,20 +637,8 @@ static void melonds::init_gba_save(
     // We load the GBA SRAM file ourselves (rather than letting the frontend do it)
     // because we'll overwrite it later and don't want the frontend to hold open any file handles.
 
-    if (path_contains_compressed_file(gba_save_info.path)) {
-        // If this save file is in an archive (e.g. /path/to/file.7z#mygame.srm)...
-
-        // We don't support GBA SRAM files in archives right now;
-        // libretro-common has APIs for extracting and re-inserting them,
-        // but I just can't be bothered.
-        retro::set_error_message(
-            "melonDS DS does not support archived GBA save data right now. "
-            "Please extract it and try again. "
-            "Continuing without using the save data."
-        );
-
-        return;
-    }
+    // Archived save files are filtered out by load_games, which reports them to the player
+    retro_assert(!path_contains_compressed_file(gba_save_info.path));
 
     // rzipstream opens the file as-is if it's not rzip-formatted
     rzipstream_t* gba_save_file = rzipstream_open(gba_save_info.path, RETRO_VFS_FILE_ACCESS_READ);
@@ -509,21 +646,10 @@ static void melonds::init_gba_save(
         throw std::runtime_error("Failed to open GBA save file");
     }
 
-    if (rzipstream_is_compressed(gba_save_file)) {
-        // If this save data is compressed in libretro's rzip format...
-        // (not to be confused with a standard archive format like zip or 7z)
-
-        // We don't support rzip-compressed GBA save files right now;
-        // I can't be bothered.
-        retro::set_error_message(
-            "melonDS DS does not support compressed GBA save data right now. "
-            "Please disable save data compression in the frontend and try again. "
-            "Continuing without using the save data."
-        );
-
-        rzipstream_close(gba_save_file);
-        return;
-    }
+    // If this save data is compressed in libretro's rzip format
+    // (not to be confused with a standard archive format like zip or 7z),
+    // we'll write it back the same way
+    _gba_save_compressed = rzipstream_is_compressed(gba_save_file);
 
     int64_t gba_save_file_size = rzipstream_get_size(gba_save_file);
     if (gba_save_file_size < 0) {
@@ -532,25 +658,23 @@ static void melonds::init_gba_save(
         throw std::runtime_error("Failed to get GBA save file size");
     }
 
-    void* gba_save_data = malloc(gba_save_file_size);
-    if (!gba_save_data) {
-        rzipstream_close(gba_save_file);
-        throw std::runtime_error("Failed to allocate memory for GBA save file");
-    }
-
-    if (rzipstream_read(gba_save_file, gba_save_data, gba_save_file_size) != gba_save_file_size) {
+    // Read (and decompress, if necessary) straight into the buffer we'll keep for the whole session
+    melonds::GbaSaveManager->SetSaveSize(gba_save_file_size);
+    if (rzipstream_read(gba_save_file, melonds::GbaSaveManager->Sram(), gba_save_file_size) != gba_save_file_size) {
         rzipstream_close(gba_save_file);
-        free(gba_save_data);
+        melonds::GbaSaveManager->SetSaveSize(0);
         throw std::runtime_error("Failed to read GBA save file");
     }
+    rzipstream_close(gba_save_file);
 
-    melonds::GbaSaveManager->SetSaveSize(gba_save_file_size);
     gba_cart.Cart()->SetupSave(gba_save_file_size);
-    gba_cart.Cart()->LoadSave(static_cast<const u8*>(gba_save_data), gba_save_file_size);
-    retro::debug("Allocated %u-byte GBA SRAM", gba_cart.Cart()->GetSaveMemoryLength());
+    gba_cart.Cart()->LoadSave(melonds::GbaSaveManager->Sram(), gba_save_file_size);
+    retro::debug(
+        "Allocated %u-byte GBA SRAM (%s on disk)",
+        gba_cart.Cart()->GetSaveMemoryLength(),
+        _gba_save_compressed ? "rzip-compressed" : "uncompressed"
+    );
     // Actually installing the SRAM will be done later, after NDS::Reset is called
-    free(gba_save_data);
-    rzipstream_close(gba_save_file);
 }
 
 // TODO: Support loading the firmware without a ROM
@@ -560,7 +684,14 @@ static void melonds::load_games(
     const optional<struct retro_game_info> &gba_save_info
 ) {
     melonds::clear_memory_config();
-    melonds::check_variables(true);
+
+    // check_variables applies the game's performance profile, so it has to know which game this is
+    std::string game_code = nds_info ? peek_game_code(*nds_info) : std::string();
+    gameprofile::Load(game_code.empty() ? nullptr : game_code.c_str());
+    {
+        profiler::Phase phase("check_variables");
+        melonds::check_variables(true);
+    }
 
     using retro::environment;
     using retro::log;
@@ -571,57 +702,256 @@ static void melonds::load_games(
 
     init_firmware_overrides();
 
-    // First parse the ROMs...
+    bool load_gba = gba_info && Config::ConsoleType != ConsoleType::DSi;
+    if (gba_info && !load_gba) {
+        retro::set_warn_message("The DSi does not support GBA connectivity. Not loading the requested GBA ROM or SRAM.");
+    }
+
+    bool load_gba_save = load_gba && gba_save_info;
+    if (load_gba_save && path_contains_compressed_file(gba_save_info->path)) {
+        // If this save file is in an archive (e.g. /path/to/file.7z#mygame.srm)...
+
+        // We don't support GBA SRAM files in archives right now;
+        // libretro-common has APIs for extracting and re-inserting them,
+        // but I just can't be bothered.
+        retro::set_error_message(
+            "melonDS DS does not support archived GBA save data right now. "
+            "Please extract it and try again. "
+            "Continuing without using the save data."
+        );
+        load_gba_save = false;
+    }
+
+    retro_time_t start = cpu_features_get_time_usec();
+
+    // Parsing the ROMs and looking for the BIOS files don't depend on each other or on the emulator,
+    // so they run on worker threads while this thread does what needs the frontend (and NDS::Init).
+    // Nothing here touches the frontend except to log.
+    optional<Task> nds_task;
     if (nds_info) {
-        // NDS::Reset() calls wipes the cart buffer so on invoke we need a reload from info->data.
-        // Since retro_reset callback doesn't pass the info struct we need to cache it.
-        parse_nds_rom(*nds_info);
+        nds_task.emplace("NDS ROM", [&nds_info] {
+            parse_nds_rom(*nds_info);
 
-        // sanity check; parse_nds_rom does the real validation
-        retro_assert(_loaded_nds_cart != nullptr);
-        retro_assert(_loaded_nds_cart->IsValid());
+            // sanity check; parse_nds_rom does the real validation
+            retro_assert(_loaded_nds_cart != nullptr);
+            retro_assert(_loaded_nds_cart->IsValid());
 
-        init_nds_save(*_loaded_nds_cart);
+            init_nds_save(*_loaded_nds_cart);
+        });
     }
 
-    if (gba_info) {
-        if (Config::ConsoleType == ConsoleType::DSi) {
-            retro::set_warn_message("The DSi does not support GBA connectivity. Not loading the requested GBA ROM or SRAM.");
-        } else {
+    optional<Task> gba_task;
+    if (load_gba) {
+        gba_task.emplace("GBA ROM", [&gba_info, &gba_save_info, load_gba_save] {
             parse_gba_rom(*gba_info);
 
-            if (gba_save_info) {
+            if (load_gba_save) {
                 init_gba_save(*_loaded_gba_cart, *gba_save_info);
             }
-            else {
+            else if (!gba_save_info) {
                 retro::info("No GBA SRAM was provided.");
             }
+        });
+    }
+
+    // Only reports whether the BIOS files are there; Config is updated on this thread once the task is done
+    bool bios_found = true;
+    Task bios_task("BIOS", [&bios_found] {
+        bios_found = find_bios();
+    });
+
+    set_input_descriptors();
+
+    {
+        profiler::Phase phase("init_rendering");
+        init_rendering();
+    }
+    audio::Init();
+    savewriter::Init();
+
+    if (!set_serialization_quirks()) {
+        retro::debug("Frontend doesn't support serialization quirks");
+    }
+
+    _warm_start = reuse_warm_emulator();
+    if (!_warm_start) {
+        profiler::Phase phase("NDS::Init");
+        if (!NDS::Init()) {
+            retro::log(RETRO_LOG_ERROR, "Failed to initialize melonDS DS.");
+            throw std::runtime_error("Failed to initialize NDS emulator.");
         }
+        _emulator_initialized = true;
     }
 
-    init_bios();
-    environment(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, (void *) &melonds::input_descriptors);
+    retro_time_t main_duration = cpu_features_get_time_usec() - start;
+
+    // Everything after this point needs the ROMs; if any task failed, its exception propagates from here
+    // (and the other tasks are joined by their destructors)
+    {
+        profiler::Phase phase("waiting for tasks");
+        if (nds_task)
+            nds_task->Wait();
 
-    init_rendering();
+        if (gba_task)
+            gba_task->Wait();
 
-    if (!NDS::Init()) {
-        retro::log(RETRO_LOG_ERROR, "Failed to initialize melonDS DS.");
-        throw std::runtime_error("Failed to initialize NDS emulator.");
+        bios_task.Wait();
     }
 
+    if (!bios_found) {
+        Config::ExternalBIOSEnable = false;
+        retro::warn("Using FreeBIOS instead of the aforementioned missing files.");
+    }
+
+    if (nds_task) {
+        profiler::Record(nds_task->Name(), start, nds_task->Duration());
+
+        // Hashes the ROM in the background; the result is picked up by retro_run whenever it's ready
+        gameid::Start(nds_info->path, _loaded_nds_cart->Header().GameCode);
+    }
+
+    if (gba_task)
+        profiler::Record(gba_task->Name(), start, gba_task->Duration());
+
+    profiler::Record(bios_task.Name(), start, bios_task.Duration());
+
+    if (!Config::ExternalBIOSEnable && _loaded_gba_cart) {
+        // If we're using FreeBIOS and are trying to load a GBA cart...
+        retro::set_warn_message(
+            "FreeBIOS does not support GBA connectivity. "
+            "Please install a native BIOS and enable it in the options menu."
+        );
+    }
+
+    retro::info(
+        "Prepared content in %.1fms: NDS ROM %.1fms, GBA ROM %.1fms, BIOS %.1fms, "
+        "in parallel with frontend setup and emulator init %.1fms",
+        (cpu_features_get_time_usec() - start) / 1000.0,
+        nds_task ? nds_task->Duration() / 1000.0 : 0.0,
+        gba_task ? gba_task->Duration() / 1000.0 : 0.0,
+        bios_task.Duration() / 1000.0,
+        main_duration / 1000.0
+    );
+
     SPU::SetInterpolation(Config::AudioInterp);
     NDS::SetConsoleType(Config::ConsoleType);
 
     if (Config::Retro::CurrentRenderer == Renderer::OpenGl) {
         log(RETRO_LOG_INFO, "Deferring initialization until the OpenGL context is ready");
         deferred_initialization_pending = true;
+
+        if (Config::Retro::FastSram) {
+            // The frontend asks for the SRAM pointer as soon as retro_load_game returns,
+            // but the cart won't exist until the first frame
+            retro::warn("Fast SRAM isn't available with the OpenGL renderer; using the regular SRAM buffer");
+        }
     } else {
         log(RETRO_LOG_INFO, "No need to defer initialization, proceeding now");
         load_games_deferred(nds_info, gba_info);
+
+        // The cart exists now, so the frontend can load the save data directly into it
+        init_fast_sram();
     }
 }
 
 
+// Reads just the game code from the ROM header, since the ROM isn't parsed until after the options are read
+static std::string melonds::peek_game_code(const struct retro_game_info &info) {
+    char header[0x10];
+    if (info.data && info.size >= sizeof(header)) {
+        memcpy(header, info.data, sizeof(header));
+    } else if (info.path && !path_contains_compressed_file(info.path)) {
+        RFILE *file = filestream_open(info.path, RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+        if (!file)
+            return {};
+
+        int64_t read = filestream_read(file, header, sizeof(header));
+        filestream_close(file);
+        if (read != static_cast<int64_t>(sizeof(header)))
+            return {};
+    } else {
+        // Zipped ROMs in low-memory mode aren't decompressed until they're parsed
+        retro::debug("Can't read the game code before parsing the ROM, so no performance profile will be applied");
+        return {};
+    }
+
+    // The game code is at a fixed offset in the ROM header
+    return std::string(header + 0x0C, 4);
+}
+
+// Ejects the carts but keeps the rest of the emulator alive,
+// so that loading another game doesn't have to reinitialize it.
+// The OpenGL renderer isn't kept, since the frontend destroys its context between games.
+static void melonds::keep_emulator_warm() noexcept {
+    if (!_emulator_initialized)
+        return;
+
+    if (Config::Retro::CurrentRenderer == Renderer::OpenGl) {
+        shut_down_emulator();
+        return;
+    }
+
+    NDSCart::EjectCart();
+    GBACart::EjectCart();
+
+    _warm_emulator.alive = true;
+    _warm_emulator.console_type = Config::ConsoleType;
+    _warm_emulator.renderer = Config::Retro::CurrentRenderer;
+#ifdef JIT_ENABLED
+    _warm_emulator.jit_enable = Config::JIT_Enable;
+    _warm_emulator.jit_fast_memory = Config::JIT_FastMemory;
+#endif
+}
+
+// If the last game left the emulator running with the same configuration, reuses it.
+// Otherwise, shuts it down so that it can be initialized again.
+// NDS::Reset (in load_games_deferred) clears the reused emulator's state either way.
+static bool melonds::reuse_warm_emulator() noexcept {
+    if (!_warm_emulator.alive)
+        return false;
+
+    _warm_emulator.alive = false;
+    bool compatible = _warm_emulator.console_type == Config::ConsoleType &&
+                      _warm_emulator.renderer == Config::Retro::CurrentRenderer;
+#ifdef JIT_ENABLED
+    // The JIT's memory is set up in NDS::Init
+    compatible = compatible &&
+                 _warm_emulator.jit_enable == Config::JIT_Enable &&
+                 _warm_emulator.jit_fast_memory == Config::JIT_FastMemory;
+#endif
+
+    if (!compatible) {
+        retro::debug("The emulator's configuration changed since the last game, reinitializing it");
+        shut_down_emulator();
+        return false;
+    }
+
+    retro::debug("Reusing the last game's emulator");
+    return true;
+}
+
+// Safe to call even if the emulator was never initialized
+static void melonds::shut_down_emulator() noexcept {
+    if (_emulator_initialized) {
+        NDS::DeInit();
+        _emulator_initialized = false;
+    }
+
+    _warm_emulator.alive = false;
+}
+
+// Cleans up after a load that threw partway through.
+// An emulator that's still waiting in _warm_emulator was never touched, so it's kept for the next game;
+// otherwise it may be holding a half-inserted cart (or be freshly initialized for a game that never started),
+// so it's shut down and the next load initializes it again.
+static void melonds::discard_failed_load() noexcept {
+    _loaded_nds_cart.reset();
+    _loaded_gba_cart.reset();
+    if (!_warm_emulator.alive) {
+        shut_down_emulator();
+    }
+}
+
 static void melonds::init_firmware_overrides() {
     // TODO: Ensure that the username is non-empty
     // TODO: Make firmware overrides configurable
@@ -668,7 +998,9 @@ static void melonds::init_nds_save(const NDSCart::NDSCartData &nds_cart) {
     }
 }
 
-static void melonds::init_bios() {
+// Runs on a worker thread, so it mustn't call into the frontend (except to log) or change Config.
+// Returns false if an external BIOS was requested but some of its files are missing.
+static bool melonds::find_bios() {
     using retro::log;
 
     // TODO: Allow user to force the use of a specific BIOS, and throw an exception if that's not possible
@@ -684,7 +1016,9 @@ static void melonds::init_bios() {
         std::array<std::string, 3> required_roms = {Config::BIOS7Path, Config::BIOS9Path, Config::FirmwarePath};
         std::vector<std::string> missing_roms;
 
-        // Check if any of the bioses / firmware files are missing
+        // Check if any of the bioses / firmware files are missing.
+        // LocalFileExists opens each file, which also puts it in the system file cache
+        // so that NDS::Reset doesn't read it from disk again.
         for (std::string &rom: required_roms) {
             if (Platform::LocalFileExists(rom)) {
                 log(RETRO_LOG_INFO, "Found %s", rom.c_str());
@@ -696,22 +1030,12 @@ static void melonds::init_bios() {
 
         // TODO: Check both $SYSTEM/filename and $SYSTEM/melonDS DS/filename
 
-        // Abort if there are any of the required roms are missing
-        if (!missing_roms.empty()) {
-            Config::ExternalBIOSEnable = false;
-            retro::log(RETRO_LOG_WARN, "Using FreeBIOS instead of the aforementioned missing files.");
-        }
-    } else {
-        retro::log(RETRO_LOG_INFO, "External BIOS is disabled, using internal FreeBIOS instead.");
+        // Fall back to FreeBIOS if any of the required roms are missing
+        return missing_roms.empty();
     }
 
-    if (!Config::ExternalBIOSEnable && _loaded_gba_cart) {
-        // If we're using FreeBIOS and are trying to load a GBA cart...
-        retro::set_warn_message(
-            "FreeBIOS does not support GBA connectivity. "
-            "Please install a native BIOS and enable it in the options menu."
-        );
-    }
+    retro::log(RETRO_LOG_INFO, "External BIOS is disabled, using internal FreeBIOS instead.");
+    return true;
 }
 
 // melonDS tightly couples the renderer with the rest of the emulation code,
@@ -725,21 +1049,34 @@ static void melonds::load_games_deferred(
     // GPU config must be initialized before NDS::Reset is called.
     // Ensure that there's a renderer, even if we're about to throw it out.
     // (GPU::SetRenderSettings may try to deinitialize a non-existing renderer)
-    GPU::InitRenderer(Config::Retro::CurrentRenderer == Renderer::OpenGl);
-    GPU::RenderSettings render_settings = Config::Retro::RenderSettings();
-    GPU::SetRenderSettings(Config::Retro::CurrentRenderer == Renderer::OpenGl, render_settings);
+    if (!_warm_start || !GPU3D::CurrentRenderer) {
+        // If we're not reusing the last game's (software) renderer...
+        profiler::Phase phase("GPU::InitRenderer");
+        GPU::InitRenderer(Config::Retro::CurrentRenderer == Renderer::OpenGl);
+    }
+
+    {
+        profiler::Phase phase("GPU::SetRenderSettings");
+        GPU::RenderSettings render_settings = Config::Retro::RenderSettings();
+        GPU::SetRenderSettings(Config::Retro::CurrentRenderer == Renderer::OpenGl, render_settings);
+    }
 
-    // Loads the BIOS, too
-    NDS::Reset();
+    {
+        // Loads the BIOS, too
+        profiler::Phase phase("NDS::Reset");
+        NDS::Reset();
+    }
 
     // The ROM must be inserted after NDS::Reset is called
 
     retro_assert(NDSCart::CartROM == nullptr);
 
+    bool homebrew = _loaded_nds_cart && _loaded_nds_cart->Header().IsHomebrew();
     if (_loaded_nds_cart) {
         // If we want to insert a NDS ROM that was previously loaded...
         retro_assert(_loaded_nds_cart->IsValid());
 
+        profiler::Phase phase("NDSCart::InsertROM");
         bool inserted = NDSCart::InsertROM(std::move(*_loaded_nds_cart));
 
         _loaded_nds_cart.reset();
@@ -758,6 +1095,7 @@ static void melonds::load_games_deferred(
 
     if (gba_info && _loaded_gba_cart) {
         // If we want to insert a GBA ROM that was previously loaded...
+        profiler::Phase phase("GBACart::InsertROM");
         bool inserted = GBACart::InsertROM(std::move(_loaded_gba_cart));
         if (!inserted) {
             // If we failed to insert the ROM, we can't continue
@@ -769,38 +1107,39 @@ static void melonds::load_games_deferred(
         retro_assert(_loaded_gba_cart == nullptr);
     }
 
-    set_up_direct_boot(nds_info.value());
+    // The savestate size depends on the carts, so it can't be measured before now
+    enable_savestates();
+
+    bootsnapshot::Init(homebrew);
+    retro_time_t boot_start = cpu_features_get_time_usec();
+    bool restored;
+    {
+        profiler::Phase phase("bootsnapshot::Restore");
+        restored = bootsnapshot::Restore();
+    }
+
+    if (!restored) {
+        profiler::Phase phase("set_up_direct_boot");
+        set_up_direct_boot(nds_info.value());
+    }
 
     NDS::Start();
 
+    if (!restored) {
+        // The BIOS boots the game over the next several frames; bootsnapshot logs how long that takes
+        retro::info("Started a normal boot in %.1fms", (cpu_features_get_time_usec() - boot_start) / 1000.0);
+        bootsnapshot::Capture();
+    } else {
+        retro::info("Booted from snapshot in %.1fms", (cpu_features_get_time_usec() - boot_start) / 1000.0);
+    }
+
     log(RETRO_LOG_INFO, "Initialized emulated console and loaded emulated game");
 
-//    micInterface.interface_version = RETRO_MICROPHONE_INTERFACE_VERSION;
-//    if (environ_cb(RETRO_ENVIRONMENT_GET_MICROPHONE_INTERFACE, &micInterface))
-//    { // ...and if the current audio driver supports microphones...
-//        if (micInterface.interface_version != RETRO_MICROPHONE_INTERFACE_VERSION)
-//        {
-//            log_cb(RETRO_LOG_WARN, "[melonDS] Expected mic interface version %u, got %u. Compatibility issues are possible.\n",
-//                   RETRO_MICROPHONE_INTERFACE_VERSION, micInterface.interface_version);
-//        }
-//
-//        log_cb(RETRO_LOG_DEBUG, "[melonDS] Microphone support available in current audio driver (version %u)\n",
-//               micInterface.interface_version);
-//
-//        retro_microphone_params_t params = {
-//                .rate = 44100 // The core engine assumes this rate
-//        };
-//        micHandle = micInterface.open_mic(&params);
-//
-//        if (micHandle)
-//        {
-//            log_cb(RETRO_LOG_INFO, "[melonDS] Initialized microphone\n");
-//        }
-//        else
-//        {
-//            log_cb(RETRO_LOG_WARN, "[melonDS] Failed to initialize microphone, emulated device will receive silence\n");
-//        }
-//    }
+    profiler::Phase phase("mic, rewind, and quick save init");
+    melonds::mic::Init();
+    melonds::rewind::Init();
+    melonds::quicksave::Init();
+    melonds::jittune::Init();
 }
 
 static void melonds::init_rendering() {
@@ -0,0 +1,121 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "mappedfile.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP_FILES
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+melonds::MappedFile::MappedFile(const u8 *data, std::size_t size, void *handle) noexcept :
+    _data(data),
+    _size(size),
+    _handle(handle) {
+}
+
+std::unique_ptr<melonds::MappedFile> melonds::MappedFile::Open(const char *path) noexcept {
+    if (!path)
+        return nullptr;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file); // The mapping keeps the file open
+    if (!mapping)
+        return nullptr;
+
+    const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+
+    return std::unique_ptr<MappedFile>(new MappedFile(static_cast<const u8 *>(view), size.QuadPart, mapping));
+#elif defined(HAVE_MMAP_FILES)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file open
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    // The ROM is read front to back while it's parsed, so read ahead aggressively
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    return std::unique_ptr<MappedFile>(new MappedFile(static_cast<const u8 *>(data), info.st_size, nullptr));
+#else
+    return nullptr;
+#endif
+}
+
+melonds::MappedFile::~MappedFile() noexcept {
+#if defined(_WIN32)
+    UnmapViewOfFile(_data);
+    CloseHandle(_handle);
+#elif defined(HAVE_MMAP_FILES)
+    munmap(const_cast<u8 *>(_data), _size);
+#endif
+}
+
+std::size_t melonds::MappedFile::ResidentBytes() const noexcept {
+#if defined(HAVE_MMAP_FILES)
+    std::size_t page_size = sysconf(_SC_PAGESIZE);
+    std::size_t pages = (_size + page_size - 1) / page_size;
+#ifdef __APPLE__
+    std::vector<char> residency(pages);
+#else
+    std::vector<unsigned char> residency(pages);
+#endif
+    if (mincore(const_cast<u8 *>(_data), _size, residency.data()) != 0)
+        return 0;
+
+    std::size_t resident = 0;
+    for (auto page : residency) {
+        if (page & 1)
+            resident++;
+    }
+
+    return resident * page_size;
+#else
+    // Windows can only report this via QueryWorkingSetEx, which is more trouble than it's worth here
+    return 0;
+#endif
+}
@@ -0,0 +1,67 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_MAPPEDFILE_HPP
+#define MELONDS_DS_MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <memory>
+
+#include <types.h>
+
+namespace melonds {
+    /// A read-only, memory-mapped view of a file.
+    /// Pages are read from disk as they're touched,
+    /// and the OS can drop them under memory pressure without writing them anywhere.
+    class MappedFile {
+    public:
+        /// Maps the entire file at \c path.
+        /// \return nullptr if the file couldn't be mapped, e.g. if it's empty
+        /// or if this platform doesn't support memory-mapped files.
+        static std::unique_ptr<MappedFile> Open(const char *path) noexcept;
+
+        ~MappedFile() noexcept;
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile(MappedFile &&) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        [[nodiscard]] const u8 *Data() const noexcept {
+            return _data;
+        }
+
+        [[nodiscard]] std::size_t Size() const noexcept {
+            return _size;
+        }
+
+        /// How much of the file is currently in physical memory, in bytes.
+        /// \return 0 if this platform can't tell us.
+        [[nodiscard]] std::size_t ResidentBytes() const noexcept;
+
+    private:
+        MappedFile(const u8 *data, std::size_t size, void *handle) noexcept;
+
+        const u8 *_data;
+        std::size_t _size;
+
+        // The Windows file mapping object; unused elsewhere
+        void *_handle;
+    };
+}
+
+#endif //MELONDS_DS_MAPPEDFILE_HPP
@@ -16,9 +16,18 @@
 
 #include "memory.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
 #include <cstring>
+#include <string>
+#include <vector>
+#include <file/config_file.h>
+#include <file/file_path.h>
+#include <retro_miscellaneous.h>
 #include <NDS.h>
 #include <NDSCart.h>
+#include <GBACart.h>
 #include <ARCodeFile.h>
 #include <AREngine.h>
 #include <frontend/qt_sdl/Config.h>
@@ -26,7 +35,13 @@
 #include "environment.hpp"
 #include "config.hpp"
 #include "info.hpp"
+#include "mic.hpp"
 #include <retro_assert.h>
+#include "timing.hpp"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 constexpr size_t DS_MEMORY_SIZE = 0x400000;
 constexpr size_t DSI_MEMORY_SIZE = 0x1000000;
@@ -39,6 +54,85 @@ namespace AREngine {
 namespace melonds {
     static ssize_t _savestate_size = SAVESTATE_SIZE_UNKNOWN;
 
+    // If true, the frontend reads and writes the cart's save memory directly,
+    // and NdsSaveManager isn't used
+    static bool _fast_sram = false;
+
+    // The length of melonDS's own savestate data, without anything the core adds to it
+    static ssize_t _raw_savestate_size = SAVESTATE_SIZE_UNKNOWN;
+
+    // Run-ahead and netplay serialize and unserialize at least once per frame,
+    // so we keep an eye on how long that takes
+    static TimingStats _serialize_timing;
+    static TimingStats _unserialize_timing;
+
+    static void log_serialization_stats();
+
+    // Remembers savestate sizes across sessions, since finding them out means serializing the entire machine
+    constexpr const char *SAVESTATE_SIZE_CACHE_NAME = "melondsds_savestate_sizes.cfg";
+
+    // True if _raw_savestate_size came from the cache rather than from a real serialization
+    static bool _savestate_size_from_cache = false;
+
+    // False until the carts are in the emulator; the savestate size depends on them
+    static bool _savestates_ready = false;
+
+    static ssize_t measure_savestate_size();
+    static std::optional<std::string> savestate_size_cache_path();
+    static std::optional<std::string> savestate_size_cache_key();
+    static ssize_t load_cached_savestate_size();
+    static void store_cached_savestate_size(ssize_t size);
+    static void forget_cached_savestate_size();
+    static void invalidate_savestate_size();
+
+    constexpr uint32_t SAVESTATE_TRAILER_MAGIC = 0x5344534D; // "MSDS" when stored little-endian
+    constexpr uint32_t SAVESTATE_TRAILER_VERSION = 1;
+
+    /// Frontend-side state that melonDS doesn't know about.
+    /// Stored at the very end of the savestate buffer, after melonDS's own data;
+    /// melonDS's savestate header records its own length, so it ignores the extra bytes.
+    struct SavestateTrailer {
+        mic::SourceState mic;
+        uint32_t version;
+        uint32_t magic;
+    };
+
+#ifdef HAVE_ZLIB
+    constexpr uint32_t COMPRESSED_SAVESTATE_MAGIC = 0x5A53444D; // "MDSZ" when stored little-endian
+    constexpr uint16_t COMPRESSED_SAVESTATE_VERSION = 1;
+    constexpr uint16_t COMPRESSION_DEFLATE = 1;
+
+    // Extra room between the compressed output and the uncompressed input that it's chasing;
+    // see serialize_compressed for details
+    constexpr size_t COMPRESSION_SAFETY_MARGIN = 64 * 1024;
+
+    /// Precedes the compressed data in a compressed savestate.
+    /// Uncompressed savestates begin with melonDS's own header (magic number "MELN") instead.
+    struct CompressedSavestateHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t algorithm;
+        uint32_t raw_size;
+        uint32_t compressed_size;
+    };
+
+    // Reused for every savestate so that zlib doesn't reallocate its internal state each time
+    static z_stream _deflate_stream;
+    static bool _deflate_stream_ready = false;
+
+    // The frontend's buffer is read-only when loading, so decompressed data has to go somewhere else
+    static std::vector<u8> _inflate_buffer;
+
+    static TimingStats _compression_timing;
+    static TimingStats _decompression_timing;
+    static uint64_t _total_raw_bytes = 0;
+    static uint64_t _total_compressed_bytes = 0;
+
+    static bool serialize_compressed(u8 *data, size_t size);
+    static bool unserialize_compressed(const u8 *data, size_t size);
+    static void log_compression_stats();
+#endif
+
     std::unique_ptr<SaveManager> NdsSaveManager = std::make_unique<SaveManager>();
     std::unique_ptr<SaveManager> GbaSaveManager = std::make_unique<SaveManager>();
 }
@@ -48,7 +142,8 @@ std::optional<int> melonds::TimeToGbaFlush = std::nullopt;
 melonds::SaveManager::SaveManager() :
     _sram(nullptr),
     _sram_length(0),
-    _buffer_length(0) {
+    _buffer_length(0),
+    _status() {
 }
 
 melonds::SaveManager::~SaveManager() {
@@ -66,6 +161,7 @@ void melonds::SaveManager::Flush(const u8 *savedata, u32 savelen, u32 writeoffse
         _sram = new u8[_sram_length];
 
         memcpy(_sram, savedata, _sram_length);
+        MarkDirty(0, _sram_length);
     } else {
         if ((writeoffset + writelen) > savelen) {
             // If the write goes past the end of the SRAM, we have to wrap around
@@ -77,7 +173,60 @@ void melonds::SaveManager::Flush(const u8 *savedata, u32 savelen, u32 writeoffse
         } else {
             memcpy(_sram + writeoffset, savedata + writeoffset, writelen);
         }
+        NoteWrite(savelen, writeoffset, writelen);
+    }
+}
+
+void melonds::SaveManager::NoteWrite(u32 savelen, u32 writeoffset, u32 writelen) {
+    if ((writeoffset + writelen) > savelen) {
+        // If the write wrapped around the end of the SRAM...
+        u32 len = savelen - writeoffset;
+        MarkDirty(writeoffset, savelen);
+        MarkDirty(0, std::min(writelen - len, savelen));
+    } else {
+        MarkDirty(writeoffset, writeoffset + writelen);
+    }
+}
+
+void melonds::SaveManager::MarkDirty(u32 start, u32 end) {
+    if (start >= end)
+        return;
+
+    if (!Dirty()) {
+        // If the consumer has caught up, start a new list
+        _status.range_count = 0;
+    }
+    _status.generation++;
+
+    SaveRamDirtyRange *ranges = _status.ranges;
+    u32 &count = _status.range_count;
+
+    // Find where the new range goes, then absorb every range that it overlaps or touches
+    u32 first = 0;
+    while (first < count && ranges[first].end < start) {
+        ++first;
+    }
+
+    u32 last = first;
+    while (last < count && ranges[last].start <= end) {
+        start = std::min(start, ranges[last].start);
+        end = std::max(end, ranges[last].end);
+        ++last;
+    }
+
+    u32 absorbed = last - first;
+    if (absorbed == 0 && count == SAVE_RAM_DIRTY_RANGE_CAPACITY) {
+        // If there's no room for another range, collapse everything into one
+        ranges[0] = { std::min(start, ranges[0].start), std::max(end, ranges[count - 1].end) };
+        count = 1;
+        return;
     }
+
+    // Replace the absorbed ranges with the merged one, shifting the rest over
+    u32 new_count = count - absorbed + 1;
+    memmove(&ranges[first + 1], &ranges[last], (count - last) * sizeof(SaveRamDirtyRange));
+    ranges[first] = { start, end };
+    count = new_count;
 }
 
 void melonds::SaveManager::SetSaveSize(u32 savelen) {
@@ -85,8 +234,12 @@ void melonds::SaveManager::SetSaveSize(u32 savelen) {
         delete[] _sram;
 
         _sram_length = savelen;
-        _sram = new u8[_sram_length];
+        _sram = savelen > 0 ? new u8[_sram_length] : nullptr;
     }
+
+    // A new buffer starts out with nothing to write, but generations keep counting up
+    _status.acknowledged_generation = _status.generation;
+    _status.range_count = 0;
 }
 
 static const char *memory_type_name(unsigned type)
@@ -102,14 +255,19 @@ static const char *memory_type_name(unsigned type)
             return "RETRO_MEMORY_VIDEO_RAM";
         case melonds::MELONDSDS_MEMORY_GBA_SAVE_RAM:
             return "MELONDSDS_MEMORY_GBA_SAVE_RAM";
+        case melonds::MELONDSDS_MEMORY_SAVE_RAM_STATUS:
+            return "MELONDSDS_MEMORY_SAVE_RAM_STATUS";
         default:
             return "<unknown>";
     }
 }
 
-/// Savestates in melonDS can vary in size depending on the game,
-/// so we have to try saving the state first before we can know how big it'll be.
 PUBLIC_SYMBOL size_t retro_serialize_size(void) {
+    if (!melonds::_savestates_ready) {
+        // If the OpenGL renderer hasn't let us insert the carts yet...
+        return 0;
+    }
+
     if (melonds::_savestate_size < 0) {
         // If we haven't yet figured out how big the savestate should be...
 
@@ -118,9 +276,33 @@ PUBLIC_SYMBOL size_t retro_serialize_size(void) {
             melonds::_savestate_size = 0;
             // TODO: When DSi mode supports savestates, remove this conditional block
         } else {
-            Savestate state;
-            NDS::DoSavestate(&state);
-            melonds::_savestate_size = state.Length();
+            ssize_t raw_size = melonds::load_cached_savestate_size();
+            melonds::_savestate_size_from_cache = raw_size > 0;
+            if (melonds::_savestate_size_from_cache) {
+                // If we've seen this exact configuration before...
+                retro::debug("Using cached savestate size of %zdB", raw_size);
+#ifndef NDEBUG
+                ssize_t measured_size = melonds::measure_savestate_size();
+                if (measured_size != raw_size) {
+                    retro::error("Cached savestate size (%zdB) doesn't match the real size (%zdB)", raw_size, measured_size);
+                }
+                retro_assert(measured_size == raw_size);
+#endif
+            } else {
+                raw_size = melonds::measure_savestate_size();
+                if (raw_size > 0) {
+                    melonds::store_cached_savestate_size(raw_size);
+                }
+            }
+
+            if (raw_size <= 0) {
+                retro::error("Failed to determine the savestate size; savestates won't be available");
+                melonds::_savestate_size = 0;
+                return 0;
+            }
+
+            melonds::_raw_savestate_size = raw_size;
+            melonds::_savestate_size = raw_size + sizeof(melonds::SavestateTrailer);
 
             retro::log(
                 RETRO_LOG_INFO,
@@ -129,26 +311,110 @@ PUBLIC_SYMBOL size_t retro_serialize_size(void) {
                 melonds::_savestate_size / 1024.0f,
                 melonds::_savestate_size / 1024.0f / 1024.0f
             );
+
+#ifdef HAVE_ZLIB
+            if (Config::Retro::CompressSavestates) {
+                // Compressed data can be slightly larger than the input if it doesn't compress well,
+                // and the frontend needs to know the size up front
+                melonds::_savestate_size =
+                    sizeof(melonds::CompressedSavestateHeader) +
+                    compressBound(melonds::_raw_savestate_size) +
+                    melonds::COMPRESSION_SAFETY_MARGIN +
+                    sizeof(melonds::SavestateTrailer);
+
+                retro::info("Reserving %dB for compressed savestates (worst case)", melonds::_savestate_size);
+
+                // Allocate the decompression buffer now, rather than in the middle of a run-ahead frame
+                melonds::_inflate_buffer.resize(melonds::_raw_savestate_size);
+            }
+#endif
         }
     }
 
     return melonds::_savestate_size;
 }
 
+// Called at least once per frame by run-ahead and netplay, so avoid logging or allocating here
 PUBLIC_SYMBOL bool retro_serialize(void *data, size_t size) {
-    memset(data, 0, size);
+    using melonds::SavestateTrailer;
+    melonds::ScopedTimer timer(melonds::_serialize_timing);
+
+    if (size < sizeof(SavestateTrailer))
+        return false;
+
+    size_t melonds_size = size - sizeof(SavestateTrailer);
+#ifdef HAVE_ZLIB
+    if (Config::Retro::CompressSavestates) {
+        if (!melonds::serialize_compressed(static_cast<u8 *>(data), melonds_size))
+            return false;
+    } else
+#endif
+    {
+        u32 length = 0;
+        {
+            // melonDS writes directly into the frontend's buffer, no intermediate copy needed
+            Savestate state(data, melonds_size, true);
+            if (!NDS::DoSavestate(&state) || state.Error) {
+                melonds::invalidate_savestate_size();
+                return false;
+            }
 
-    Savestate state(data, size, true);
+            length = state.Length();
+        } // melonDS finishes writing the savestate's header when it's destroyed
 
-    return NDS::DoSavestate(&state) && !state.Error;
+        // Only zero out the bytes that melonDS didn't write (usually none),
+        // so that identical emulator states always produce identical buffers
+        memset(static_cast<u8 *>(data) + length, 0, melonds_size - length);
+    }
+
+    SavestateTrailer trailer {
+        .mic = melonds::mic::GetSourceState(),
+        .version = melonds::SAVESTATE_TRAILER_VERSION,
+        .magic = melonds::SAVESTATE_TRAILER_MAGIC,
+    };
+    memcpy(static_cast<u8 *>(data) + melonds_size, &trailer, sizeof(trailer));
+
+    return true;
 }
 
+// Called at least once per frame by run-ahead and netplay, so avoid logging or allocating here
 PUBLIC_SYMBOL bool retro_unserialize(const void *data, size_t size) {
-    retro::log(RETRO_LOG_DEBUG, "retro_unserialize(%p, %d)", data, size);
+    using melonds::SavestateTrailer;
+    melonds::ScopedTimer timer(melonds::_unserialize_timing);
+
+    SavestateTrailer trailer {};
+    bool has_trailer = false;
+    if (size >= sizeof(SavestateTrailer)) {
+        memcpy(&trailer, static_cast<const u8 *>(data) + size - sizeof(trailer), sizeof(trailer));
+        has_trailer = trailer.magic == melonds::SAVESTATE_TRAILER_MAGIC &&
+                      trailer.version == melonds::SAVESTATE_TRAILER_VERSION;
+    }
 
-    Savestate savestate((u8 *) data, size, false);
+    // Savestates made before the trailer existed are still accepted; they just don't restore the mic sources
+    size_t melonds_size = has_trailer ? size - sizeof(SavestateTrailer) : size;
 
-    return NDS::DoSavestate(&savestate) && !savestate.Error;
+    uint32_t magic = 0;
+    if (melonds_size >= sizeof(magic)) {
+        memcpy(&magic, data, sizeof(magic));
+    }
+
+#ifdef HAVE_ZLIB
+    if (magic == melonds::COMPRESSED_SAVESTATE_MAGIC) {
+        if (!melonds::unserialize_compressed(static_cast<const u8 *>(data), melonds_size))
+            return false;
+    } else
+#endif
+    {
+        Savestate savestate((u8 *) data, melonds_size, false);
+        if (!NDS::DoSavestate(&savestate) || savestate.Error)
+            return false;
+    }
+
+    if (has_trailer) {
+        melonds::mic::SetSourceState(trailer.mic);
+    }
+
+    return true;
 }
 
 PUBLIC_SYMBOL void *retro_get_memory_data(unsigned type) {
@@ -157,7 +423,12 @@ PUBLIC_SYMBOL void *retro_get_memory_data(unsigned type) {
         case RETRO_MEMORY_SYSTEM_RAM:
             return NDS::MainRAM;
         case RETRO_MEMORY_SAVE_RAM:
+            if (melonds::_fast_sram)
+                return NDSCart::GetSaveMemory();
+
             return melonds::NdsSaveManager->Sram();
+        case melonds::MELONDSDS_MEMORY_SAVE_RAM_STATUS:
+            return melonds::NdsSaveManager->MutableStatus();
         default:
             return nullptr;
     }
@@ -178,7 +449,12 @@ PUBLIC_SYMBOL size_t retro_get_memory_size(unsigned type) {
                     return DSI_MEMORY_SIZE; // 16MB, the size of the DSi system RAM
             }
         case RETRO_MEMORY_SAVE_RAM:
+            if (melonds::_fast_sram)
+                return NDSCart::GetSaveMemoryLength();
+
             return melonds::NdsSaveManager->SramLength();
+        case melonds::MELONDSDS_MEMORY_SAVE_RAM_STATUS:
+            return sizeof(melonds::SaveRamStatus);
         default:
             return 0;
     }
@@ -236,6 +512,418 @@ bool melonds::set_memory_descriptors() {
     return retro::environment(RETRO_ENVIRONMENT_SET_MEMORY_MAPS, &memory_map);
 }
 
+void melonds::init_fast_sram() {
+    _fast_sram = false;
+
+    if (!Config::Retro::FastSram)
+        return;
+
+    u8 *save_memory = NDSCart::GetSaveMemory();
+    u32 save_length = NDSCart::GetSaveMemoryLength();
+    if (!save_memory || save_length == 0) {
+        // If this cart doesn't have save memory (e.g. it's homebrew)...
+        retro::debug("Loaded game has no cart save memory, Fast SRAM has nothing to do");
+        return;
+    }
+
+    _fast_sram = true;
+
+    // The frontend will load the save data straight into the cart, so the shadow copy isn't needed
+    NdsSaveManager->SetSaveSize(0);
+    retro::info("Fast SRAM enabled; the frontend has direct access to the cart's %uB of save memory", save_length);
+}
+
+bool melonds::fast_sram_active() noexcept {
+    return _fast_sram;
+}
+
+size_t melonds::raw_savestate_size() {
+    if (_raw_savestate_size == SAVESTATE_SIZE_UNKNOWN) {
+        // Finds out the size as a side effect
+        retro_serialize_size();
+    }
+
+    return _raw_savestate_size > 0 ? static_cast<size_t>(_raw_savestate_size) : 0;
+}
+
+void melonds::enable_savestates() noexcept {
+    _savestates_ready = true;
+}
+
+bool melonds::set_serialization_quirks() {
+    // The savestate size is usually fixed once a game is running,
+    // but it's measured again if a savestate ever outgrows it (see invalidate_savestate_size),
+    // and it's 0 until the carts are inserted (which the OpenGL renderer defers to the first frame).
+    // The SRAM isn't installed until the first frame runs, either.
+    // melonDS writes savestates in the host's byte order.
+    uint64_t quirks =
+        RETRO_SERIALIZATION_QUIRK_CORE_VARIABLE_SIZE |
+        RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE |
+        RETRO_SERIALIZATION_QUIRK_ENDIAN_DEPENDENT;
+
+    return retro::environment(RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS, &quirks);
+}
+
 void melonds::clear_memory_config() {
+    log_serialization_stats();
+
+    _savestate_size = SAVESTATE_SIZE_UNKNOWN;
+    _raw_savestate_size = SAVESTATE_SIZE_UNKNOWN;
+    _savestate_size_from_cache = false;
+    _savestates_ready = false;
+    _fast_sram = false;
+
+#ifdef HAVE_ZLIB
+    log_compression_stats();
+
+    if (_deflate_stream_ready) {
+        deflateEnd(&_deflate_stream);
+        _deflate_stream_ready = false;
+    }
+
+    _inflate_buffer.clear();
+    _inflate_buffer.shrink_to_fit();
+#endif
+}
+
+/// Savestates in melonDS can vary in size depending on the game,
+/// so we have to try saving the state first before we can know how big it'll be.
+static ssize_t melonds::measure_savestate_size() {
+    Savestate state;
+    if (!NDS::DoSavestate(&state) || state.Error)
+        return SAVESTATE_SIZE_UNKNOWN;
+
+    return state.Length();
+}
+
+static std::optional<std::string> melonds::savestate_size_cache_path() {
+    const std::optional<std::string> &save_directory = retro::get_save_directory();
+    if (!save_directory)
+        return std::nullopt;
+
+    char path[PATH_MAX_LENGTH];
+    fill_pathname_join_special(path, save_directory->c_str(), SAVESTATE_SIZE_CACHE_NAME, sizeof(path));
+    return std::string(path);
+}
+
+/// Identifies everything that affects the size of a savestate:
+/// melonDS's savestate version, the console type, the NDS game and its save size,
+/// and the GBA game (if any) and its save size (which is what melonDS picks the GBA save type from).
+/// \return std::nullopt if no NDS cart is inserted, since there'd be nothing to tell one game's size from another's.
+static std::optional<std::string> melonds::savestate_size_cache_key() {
+    if (!NDSCart::CartROM)
+        return std::nullopt;
+
+    // The game code and header checksum are at fixed offsets in the ROM header
+    char game_code[5] = {};
+    memcpy(game_code, NDSCart::CartROM + 0x0C, 4);
+    for (char &c : game_code) {
+        if (c != '\0' && !isalnum(static_cast<unsigned char>(c)))
+            // Keep the key usable as a config file key
+            c = '_';
+    }
+    unsigned header_crc = NDSCart::CartROM[0x15E] | (NDSCart::CartROM[0x15F] << 8);
+
+    char gba_game_code[5] = "none";
+    unsigned gba_header_checksum = 0;
+    u32 gba_rom_size = 0;
+    u32 gba_save_size = 0;
+    if (GBACart::CartROM && GBACart::CartROMSize >= 0xC0) {
+        // The game code and header checksum are at fixed offsets in the GBA ROM header, too
+        memcpy(gba_game_code, GBACart::CartROM + 0xAC, 4);
+        for (char &c : gba_game_code) {
+            if (c != '\0' && !isalnum(static_cast<unsigned char>(c)))
+                c = '_';
+        }
+        gba_header_checksum = GBACart::CartROM[0xBD];
+        gba_rom_size = GBACart::CartROMSize;
+        gba_save_size = GbaSaveManager ? GbaSaveManager->SramLength() : 0;
+    }
+
+    char key[160];
+    snprintf(
+        key,
+        sizeof(key),
+        "v%d.%d_%s_%s_%04x_nds%u_gba_%s_%02x_%u_%u",
+        SAVESTATE_MAJOR,
+        SAVESTATE_MINOR,
+        Config::ConsoleType == ConsoleType::DSi ? "dsi" : "ds",
+        game_code,
+        header_crc,
+        NDSCart::GetSaveMemoryLength(),
+        gba_game_code,
+        gba_header_checksum,
+        gba_rom_size,
+        gba_save_size
+    );
+
+    return std::string(key);
+}
+
+static ssize_t melonds::load_cached_savestate_size() {
+    std::optional<std::string> key = savestate_size_cache_key();
+    std::optional<std::string> path = savestate_size_cache_path();
+    if (!key || !path || !path_is_valid(path->c_str()))
+        return SAVESTATE_SIZE_UNKNOWN;
+
+    config_file_t *cache = config_file_new_from_path_to_string(path->c_str());
+    if (!cache)
+        return SAVESTATE_SIZE_UNKNOWN;
+
+    unsigned size = 0;
+    bool found = config_get_uint(cache, key->c_str(), &size);
+    config_file_free(cache);
+
+    return found && size > 0 ? static_cast<ssize_t>(size) : SAVESTATE_SIZE_UNKNOWN;
+}
+
+static void melonds::store_cached_savestate_size(ssize_t size) {
+    std::optional<std::string> key = savestate_size_cache_key();
+    std::optional<std::string> path = savestate_size_cache_path();
+    if (!key || !path)
+        return;
+
+    config_file_t *cache = path_is_valid(path->c_str()) ? config_file_new_from_path_to_string(path->c_str()) : nullptr;
+    if (!cache) {
+        cache = config_file_new_alloc();
+    }
+
+    if (!cache)
+        return;
+
+    config_set_uint(cache, key->c_str(), static_cast<unsigned>(size));
+    if (!config_file_write(cache, path->c_str(), true)) {
+        retro::warn("Failed to write savestate size cache to \"%s\"", path->c_str());
+    }
+    config_file_free(cache);
+}
+
+static void melonds::forget_cached_savestate_size() {
+    _savestate_size_from_cache = false;
+
+    std::optional<std::string> key = savestate_size_cache_key();
+    std::optional<std::string> path = savestate_size_cache_path();
+    if (!key || !path || !path_is_valid(path->c_str()))
+        return;
+
+    config_file_t *cache = config_file_new_from_path_to_string(path->c_str());
+    if (!cache)
+        return;
+
+    retro::warn("Cached savestate size for %s was wrong; it'll be measured again", key->c_str());
+    config_unset(cache, key->c_str());
+    config_file_write(cache, path->c_str(), true);
+    config_file_free(cache);
+}
+
+/// Called when a savestate didn't fit in the space that retro_serialize_size promised.
+/// The cached size (if that's where it came from) is dropped,
+/// and the next call to retro_serialize_size measures and caches it again.
+static void melonds::invalidate_savestate_size() {
+    if (_savestate_size_from_cache) {
+        // If the cached size was stale (e.g. melonDS changed its savestate format without bumping the version)...
+        forget_cached_savestate_size();
+    }
+
     _savestate_size = SAVESTATE_SIZE_UNKNOWN;
-}
\ No newline at end of file
+    _raw_savestate_size = SAVESTATE_SIZE_UNKNOWN;
+}
+
+static void melonds::log_serialization_stats() {
+    if (_serialize_timing.Count() > 0) {
+        retro::info(
+            "Serialized %llu times, taking %.1fus each on average (min %lldus, max %lldus)",
+            static_cast<unsigned long long>(_serialize_timing.Count()),
+            _serialize_timing.Average(),
+            static_cast<long long>(_serialize_timing.Min()),
+            static_cast<long long>(_serialize_timing.Max())
+        );
+    }
+
+    if (_unserialize_timing.Count() > 0) {
+        retro::info(
+            "Unserialized %llu times, taking %.1fus each on average (min %lldus, max %lldus)",
+            static_cast<unsigned long long>(_unserialize_timing.Count()),
+            _unserialize_timing.Average(),
+            static_cast<long long>(_unserialize_timing.Min()),
+            static_cast<long long>(_unserialize_timing.Max())
+        );
+    }
+
+    double round_trip = _serialize_timing.Average() + _unserialize_timing.Average();
+    if (_serialize_timing.Count() > 0 && _unserialize_timing.Count() > 0 && round_trip > 0) {
+        retro::info("That's about %.0f serialize/unserialize round-trips per second", 1000000.0 / round_trip);
+    }
+
+    _serialize_timing.Reset();
+    _unserialize_timing.Reset();
+}
+
+#ifdef HAVE_ZLIB
+/// Serializes the emulator into \c data and compresses it in-place,
+/// so that no second savestate-sized buffer is needed.
+///
+/// melonDS writes the uncompressed savestate to the end of the buffer,
+/// and zlib writes its output to the front of the buffer.
+/// zlib consumes its input before it emits the corresponding output,
+/// and the output for any prefix of the input is never more than
+/// compressBound's overhead larger than that prefix.
+/// retro_serialize_size reserves that overhead (plus a safety margin) in front of the input,
+/// so the output never catches up to input that hasn't been read yet.
+static bool melonds::serialize_compressed(u8 *data, size_t size) {
+    constexpr size_t header_size = sizeof(CompressedSavestateHeader);
+
+    if (_raw_savestate_size <= 0) {
+        retro::error("Savestate size is unknown; retro_serialize_size must be called first");
+        return false;
+    }
+
+    size_t raw_capacity = _raw_savestate_size;
+    if (size < header_size + compressBound(raw_capacity) + COMPRESSION_SAFETY_MARGIN) {
+        retro::error("Savestate buffer is too small (%zuB) for compression", size);
+        return false;
+    }
+
+    u8 *raw = data + size - raw_capacity;
+    u32 raw_length = 0;
+    {
+        Savestate state(raw, raw_capacity, true);
+        if (!NDS::DoSavestate(&state) || state.Error) {
+            invalidate_savestate_size();
+            return false;
+        }
+
+        raw_length = state.Length();
+    } // melonDS finishes writing the savestate's header when it's destroyed
+
+    retro_time_t start = cpu_features_get_time_usec();
+    if (!_deflate_stream_ready) {
+        memset(&_deflate_stream, 0, sizeof(_deflate_stream));
+        if (deflateInit(&_deflate_stream, Z_BEST_SPEED) != Z_OK) {
+            retro::error("Failed to initialize savestate compression");
+            return false;
+        }
+        _deflate_stream_ready = true;
+    } else {
+        deflateReset(&_deflate_stream);
+    }
+
+    _deflate_stream.next_in = raw;
+    _deflate_stream.avail_in = raw_length;
+    _deflate_stream.next_out = data + header_size;
+    _deflate_stream.avail_out = size - header_size;
+
+    int result = deflate(&_deflate_stream, Z_FINISH);
+    if (result != Z_STREAM_END) {
+        retro::error("Failed to compress savestate (zlib error %d)", result);
+        return false;
+    }
+
+    retro_time_t elapsed = cpu_features_get_time_usec() - start;
+    _compression_timing.Add(elapsed);
+
+    auto compressed_length = static_cast<u32>(_deflate_stream.total_out);
+    CompressedSavestateHeader header {
+        .magic = COMPRESSED_SAVESTATE_MAGIC,
+        .version = COMPRESSED_SAVESTATE_VERSION,
+        .algorithm = COMPRESSION_DEFLATE,
+        .raw_size = raw_length,
+        .compressed_size = compressed_length,
+    };
+    memcpy(data, &header, sizeof(header));
+
+    // Clear out what's left of the uncompressed input,
+    // so that the frontend's own compression and rewind deltas see nothing but zeroes
+    memset(data + header_size + compressed_length, 0, size - header_size - compressed_length);
+
+    _total_raw_bytes += raw_length;
+    _total_compressed_bytes += compressed_length;
+
+    return true;
+}
+
+static bool melonds::unserialize_compressed(const u8 *data, size_t size) {
+    constexpr size_t header_size = sizeof(CompressedSavestateHeader);
+    if (size < header_size)
+        return false;
+
+    CompressedSavestateHeader header {};
+    memcpy(&header, data, sizeof(header));
+
+    if (header.version != COMPRESSED_SAVESTATE_VERSION || header.algorithm != COMPRESSION_DEFLATE) {
+        retro::error(
+            "Unsupported compressed savestate (version %u, algorithm %u)",
+            header.version,
+            header.algorithm
+        );
+        return false;
+    }
+
+    if (header.compressed_size > size - header_size) {
+        retro::error("Compressed savestate is truncated (expected %uB of data)", header.compressed_size);
+        return false;
+    }
+
+    // The header comes from outside the core, so it can't be allowed to pick how much memory we allocate.
+    // A valid state is never bigger than this session's own savestates.
+    if (_raw_savestate_size <= 0) {
+        // If the frontend is loading a state before it's asked how big one is...
+        retro_serialize_size();
+    }
+
+    size_t max_raw_size = _raw_savestate_size > 0 ? _raw_savestate_size + sizeof(SavestateTrailer) : 0;
+    if (header.raw_size == 0 || header.raw_size > max_raw_size) {
+        retro::error(
+            "Compressed savestate claims to be %uB uncompressed, but savestates for this game are at most %zuB",
+            header.raw_size,
+            max_raw_size
+        );
+        return false;
+    }
+
+    if (_inflate_buffer.size() < header.raw_size) {
+        _inflate_buffer.resize(header.raw_size);
+    }
+
+    {
+        ScopedTimer timer(_decompression_timing);
+        uLongf raw_length = header.raw_size;
+        int result = uncompress(_inflate_buffer.data(), &raw_length, data + header_size, header.compressed_size);
+        if (result != Z_OK || raw_length != header.raw_size) {
+            retro::error("Failed to decompress savestate (zlib error %d)", result);
+            return false;
+        }
+    }
+
+    Savestate savestate(_inflate_buffer.data(), header.raw_size, false);
+    return NDS::DoSavestate(&savestate) && !savestate.Error;
+}
+
+static void melonds::log_compression_stats() {
+    if (_compression_timing.Count() > 0) {
+        retro::info(
+            "Compressed %llu savestates to %.1f%% of their size on average, taking %.1fus each (min %lldus, max %lldus)",
+            static_cast<unsigned long long>(_compression_timing.Count()),
+            _total_raw_bytes ? 100.0 * _total_compressed_bytes / _total_raw_bytes : 0.0,
+            _compression_timing.Average(),
+            static_cast<long long>(_compression_timing.Min()),
+            static_cast<long long>(_compression_timing.Max())
+        );
+    }
+
+    if (_decompression_timing.Count() > 0) {
+        retro::info(
+            "Decompressed %llu savestates, taking %.1fus each (min %lldus, max %lldus)",
+            static_cast<unsigned long long>(_decompression_timing.Count()),
+            _decompression_timing.Average(),
+            static_cast<long long>(_decompression_timing.Min()),
+            static_cast<long long>(_decompression_timing.Max())
+        );
+    }
+
+    _compression_timing.Reset();
+    _decompression_timing.Reset();
+    _total_raw_bytes = 0;
+    _total_compressed_bytes = 0;
+}
+#endif
\ No newline at end of file
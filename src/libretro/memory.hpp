@@ -30,10 +30,61 @@ namespace melonds {
 
     bool set_memory_descriptors();
 
+    /// Tells the frontend what to expect from our savestates,
+    /// so that run-ahead and netplay know when to ask for their size again.
+    bool set_serialization_quirks();
+
+    /// Lets retro_serialize_size measure the savestate size.
+    /// Must be called once the carts are inserted; until then, savestates have a size of 0.
+    void enable_savestates() noexcept;
+
     constexpr unsigned NINTENDO_DS_MEMORY_SAVE_RAM = 0x101;
 
     void clear_memory_config();
 
+    constexpr size_t SAVE_RAM_DIRTY_RANGE_CAPACITY = 16;
+
+    struct SaveRamDirtyRange {
+        uint32_t start;
+        uint32_t end; // exclusive
+    };
+
+    /// Describes what changed in a save buffer, so that autosave can skip work when nothing did.
+    /// Frontends get a live pointer to this via retro_get_memory_data(MELONDSDS_MEMORY_SAVE_RAM_STATUS).
+    ///
+    /// To use it, compare \c generation against \c acknowledged_generation.
+    /// If they're equal, the save data hasn't changed since it was last written out.
+    /// Otherwise, write out the bytes in \c ranges (or all of it), then set \c acknowledged_generation to \c generation.
+    /// The core clears \c ranges the next time the save data changes after that.
+    struct SaveRamStatus {
+        /// Incremented every time the save data changes. Never decreases.
+        uint64_t generation;
+
+        /// The last generation that the consumer wrote out. Written by the consumer, not the core.
+        uint64_t acknowledged_generation;
+
+        /// Number of entries in \c ranges that are in use.
+        /// If there were too many distinct writes to track, this is 1 and the range covers all of them.
+        uint32_t range_count;
+        uint32_t reserved;
+
+        /// Byte ranges written since \c acknowledged_generation, sorted and non-overlapping.
+        SaveRamDirtyRange ranges[SAVE_RAM_DIRTY_RANGE_CAPACITY];
+    };
+
+    /// If Fast SRAM is enabled and the cart has save memory,
+    /// hands the frontend the cart's own save memory instead of a shadow copy.
+    /// Must be called after the cart is inserted, but before retro_load_game returns.
+    void init_fast_sram();
+
+    /// True if the frontend has direct access to the cart's save memory.
+    bool fast_sram_active() noexcept;
+
+    /// The length of melonDS's own savestate data for the loaded game, without anything the core adds to it.
+    /// Measured (or read from the savestate size cache) the first time it's needed, like retro_serialize_size.
+    /// \return 0 if the size couldn't be determined.
+    size_t raw_savestate_size();
+
     /// An intermediate save buffer used as a staging ground between retro_get_memory and NDSCart::LoadSave.
     class SaveManager {
     public:
@@ -60,6 +111,7 @@ namespace melonds {
         /// Allocates a buffer for SRAM of the given length.
         /// Does nothing if the SRAM buffer is already of the given length.
         /// Will clear whatever data is in the buffer.
+        /// A length of 0 frees the buffer.
         void SetSaveSize(u32 savelen);
 
         [[nodiscard]] const u8 *Sram() const {
@@ -74,10 +126,40 @@ namespace melonds {
             return _sram_length;
         }
 
+        /// Records a write without copying anything;
+        /// for when the consumer reads the cart's save memory directly (see Fast SRAM).
+        void NoteWrite(u32 savelen, u32 writeoffset, u32 writelen);
+
+        /// True if SRAM was written since the last call to Acknowledge.
+        [[nodiscard]] bool Dirty() const {
+            return _status.generation != _status.acknowledged_generation;
+        }
+
+        [[nodiscard]] uint64_t Generation() const {
+            return _status.generation;
+        }
+
+        [[nodiscard]] const SaveRamStatus &Status() const {
+            return _status;
+        }
+
+        /// The frontend acknowledges writes through this pointer, so it must not be const.
+        SaveRamStatus *MutableStatus() {
+            return &_status;
+        }
+
+        /// Marks everything written so far as handled.
+        void Acknowledge() {
+            _status.acknowledged_generation = _status.generation;
+        }
+
     private:
+        void MarkDirty(u32 start, u32 end);
+
         u8 *_sram;
         u32 _sram_length;
         u32 _buffer_length;
+        SaveRamStatus _status;
     };
 
     extern std::unique_ptr<SaveManager> NdsSaveManager;
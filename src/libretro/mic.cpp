@@ -0,0 +1,376 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "mic.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <file/file_path.h>
+#include <frontend/FrontendUtil.h>
+#include <libretro.h>
+#include <NDS.h>
+#include <retro_miscellaneous.h>
+
+#include "environment.hpp"
+#include "ringbuffer.hpp"
+#include "timing.hpp"
+
+namespace melonds::mic {
+    // Enough room for the highest sample rate a host microphone is likely to use
+    constexpr size_t MAX_DEVICE_SAMPLES_PER_FRAME = 4096;
+
+    // If more than this many frames of input pile up, the oldest samples are discarded
+    // so that the emulated mic doesn't fall behind the player
+    constexpr size_t MAX_BUFFERED_FRAMES = 4;
+
+    // Absorbs the jitter between how much the host microphone delivers and how much the DS consumes each frame
+    static SpscRingBuffer<int16_t> _buffer(MAX_DEVICE_SAMPLES_PER_FRAME * MAX_BUFFERED_FRAMES * 2);
+
+    /// A source of microphone input on the host.
+    class Device {
+    public:
+        virtual ~Device() = default;
+        virtual bool SetActive(bool active) = 0;
+
+        /// Reads up to \c count samples of mono audio.
+        /// \return The number of samples read, or a negative value on error.
+        virtual int Read(int16_t *samples, size_t count) = 0;
+        [[nodiscard]] virtual unsigned SampleRate() const = 0;
+        [[nodiscard]] virtual const char *Name() const = 0;
+    };
+
+#ifdef RETRO_ENVIRONMENT_GET_MICROPHONE_INTERFACE
+    /// A microphone provided by the frontend.
+    class HostDevice final : public Device {
+    public:
+        HostDevice(const retro_microphone_interface &interface, retro_microphone_t *microphone) :
+            _interface(interface),
+            _microphone(microphone) {
+            retro_microphone_params_t params {};
+            _rate = _interface.get_params(_microphone, &params) ? params.rate : DS_MIC_SAMPLE_RATE;
+        }
+
+        ~HostDevice() override {
+            _interface.close_mic(_microphone);
+        }
+
+        bool SetActive(bool active) override {
+            return _interface.set_mic_state(_microphone, active);
+        }
+
+        int Read(int16_t *samples, size_t count) override {
+            return _interface.read_mic(_microphone, samples, count);
+        }
+
+        [[nodiscard]] unsigned SampleRate() const override { return _rate; }
+        [[nodiscard]] const char *Name() const override { return "host microphone"; }
+
+    private:
+        retro_microphone_interface _interface;
+        retro_microphone_t *_microphone;
+        unsigned _rate;
+    };
+#endif
+
+    /// Plays a file on a loop as if it were coming from a microphone,
+    /// so that the microphone path can be exercised without audio hardware.
+    class FileDevice final : public Device {
+    public:
+        /// \param source The recording that's already loaded for the synthetic file input mode;
+        /// it's shared rather than copied, so the file is only ever decoded once.
+        explicit FileDevice(TableSource &source) noexcept : _source(source) {}
+
+        bool SetActive(bool active) override {
+            _active = active;
+            return true;
+        }
+
+        int Read(int16_t *samples, size_t count) override {
+            if (!_active)
+                return 0;
+
+            _source.Generate(samples, count);
+            return static_cast<int>(count);
+        }
+
+        [[nodiscard]] unsigned SampleRate() const override { return DS_MIC_SAMPLE_RATE; }
+        [[nodiscard]] const char *Name() const override { return "stand-in microphone file"; }
+
+    private:
+        TableSource &_source;
+        bool _active = false;
+    };
+
+    static std::unique_ptr<Device> _device;
+    static bool _active = false;
+    static TimingStats _feed_timing;
+
+    // The synthetic sources; their tables are built once and reused for every session
+    static WhiteNoiseSource _white_noise;
+    static TableSource _blow;
+    static TableSource _tone;
+    static TableSource _file;
+
+    static void feed_host_mic();
+    static std::unique_ptr<Device> open_host_device();
+    static std::unique_ptr<Device> open_file_device();
+    static std::optional<std::string> stand_in_file_path();
+    static void resample(const int16_t *input, size_t input_size, int16_t *output, size_t output_size) noexcept;
+}
+
+void melonds::mic::Init() {
+    _buffer.Clear();
+    _active = false;
+    _feed_timing.Reset();
+
+    if (_blow.Empty()) {
+        _blow = TableSource(MakeBlowTable());
+    }
+
+    if (_tone.Empty()) {
+        _tone = TableSource(MakeToneTable(TONE_PERIOD, TONE_AMPLITUDE));
+    }
+
+    if (std::optional<std::string> path = stand_in_file_path(); path && _file.Empty()) {
+        _file = TableSource(LoadPcmTable(path->c_str()));
+    }
+
+    // Every session starts from the same state so that mic input is reproducible
+    _white_noise.Seed(DEFAULT_NOISE_SEED);
+    _blow.SetPosition(0);
+    _tone.SetPosition(0);
+    _file.SetPosition(0);
+
+    _device = open_host_device();
+    if (!_device) {
+        _device = open_file_device();
+    }
+
+    if (_device) {
+        _device->SetActive(false);
+        retro::info("Using the %s (%u Hz) as microphone input", _device->Name(), _device->SampleRate());
+    } else {
+        retro::warn("No microphone is available; the emulated microphone will receive silence");
+    }
+}
+
+void melonds::mic::DeInit() {
+    if (_feed_timing.Count() > 0) {
+        retro::info(
+            "Microphone input took %.1fus per frame on average (min %lldus, max %lldus, %llu frames)",
+            _feed_timing.Average(),
+            static_cast<long long>(_feed_timing.Min()),
+            static_cast<long long>(_feed_timing.Max()),
+            static_cast<unsigned long long>(_feed_timing.Count())
+        );
+    }
+
+    _device = nullptr;
+    _active = false;
+    _buffer.Clear();
+}
+
+void melonds::mic::SetActive(bool active) {
+    if (active == _active || !_device)
+        // If there's nothing to change...
+        return;
+
+    if (!_device->SetActive(active)) {
+        retro::error("Failed to %s the %s", active ? "enable" : "disable", _device->Name());
+        return;
+    }
+
+    _active = active;
+    if (!active) {
+        // Don't let stale input play the next time the mic is turned on
+        _buffer.Clear();
+    }
+
+    retro::debug("%s the %s", active ? "Enabled" : "Disabled", _device->Name());
+}
+
+void melonds::mic::Feed(MicInputMode mode) {
+    static int16_t ds_samples[DS_MIC_SAMPLES_PER_FRAME];
+
+    ScopedTimer timer(_feed_timing);
+
+    Source *source = nullptr;
+    switch (mode) {
+        case MicInputMode::HostMic:
+            feed_host_mic();
+            return;
+        case MicInputMode::WhiteNoise:
+            source = &_white_noise;
+            break;
+        case MicInputMode::BlowNoise:
+            source = &_blow;
+            break;
+        case MicInputMode::Tone:
+            source = &_tone;
+            break;
+        case MicInputMode::File:
+            source = &_file;
+            break;
+        case MicInputMode::None:
+        default:
+            Frontend::Mic_FeedSilence();
+            return;
+    }
+
+    source->Generate(ds_samples, DS_MIC_SAMPLES_PER_FRAME);
+    NDS::MicInputFrame(ds_samples, DS_MIC_SAMPLES_PER_FRAME);
+}
+
+melonds::mic::SourceState melonds::mic::GetSourceState() noexcept {
+    SourceState state {};
+    memcpy(state.noise_lanes, _white_noise.Lanes(), sizeof(state.noise_lanes));
+    state.blow_position = _blow.Position();
+    state.tone_position = _tone.Position();
+    state.file_position = _file.Position();
+
+    return state;
+}
+
+void melonds::mic::SetSourceState(const SourceState &state) noexcept {
+    _white_noise.SetLanes(state.noise_lanes);
+    _blow.SetPosition(state.blow_position);
+    _tone.SetPosition(state.tone_position);
+    _file.SetPosition(state.file_position);
+}
+
+static void melonds::mic::feed_host_mic() {
+    static int16_t device_samples[MAX_DEVICE_SAMPLES_PER_FRAME];
+    static int16_t ds_samples[DS_MIC_SAMPLES_PER_FRAME];
+
+    if (!_device || !_active) {
+        Frontend::Mic_FeedSilence();
+        return;
+    }
+
+    // How many samples the host mic produces in the time the DS consumes one frame's worth
+    size_t samples_per_frame = (_device->SampleRate() * DS_MIC_SAMPLES_PER_FRAME + DS_MIC_SAMPLE_RATE / 2) / DS_MIC_SAMPLE_RATE;
+    samples_per_frame = std::clamp<size_t>(samples_per_frame, 1, MAX_DEVICE_SAMPLES_PER_FRAME);
+
+    int samples_read = _device->Read(device_samples, std::min(samples_per_frame, _buffer.Free()));
+    if (samples_read > 0) {
+        _buffer.Write(device_samples, samples_read);
+    }
+
+    size_t max_buffered = samples_per_frame * MAX_BUFFERED_FRAMES;
+    if (_buffer.Size() > max_buffered) {
+        // If the host mic delivered a burst of input, drop the oldest so that we catch up
+        _buffer.Skip(_buffer.Size() - max_buffered);
+    }
+
+    size_t available = _buffer.Read(device_samples, samples_per_frame);
+    if (available == 0) {
+        // If the host mic hasn't delivered anything yet...
+        Frontend::Mic_FeedSilence();
+        return;
+    }
+
+    resample(device_samples, available, ds_samples, DS_MIC_SAMPLES_PER_FRAME);
+    NDS::MicInputFrame(ds_samples, DS_MIC_SAMPLES_PER_FRAME);
+}
+
+static std::unique_ptr<melonds::mic::Device> melonds::mic::open_host_device() {
+#ifdef RETRO_ENVIRONMENT_GET_MICROPHONE_INTERFACE
+    retro_microphone_interface interface {};
+    interface.interface_version = RETRO_MICROPHONE_INTERFACE_VERSION;
+    if (!retro::environment(RETRO_ENVIRONMENT_GET_MICROPHONE_INTERFACE, &interface)) {
+        retro::info("The frontend doesn't support microphones");
+        return nullptr;
+    }
+
+    if (interface.interface_version != RETRO_MICROPHONE_INTERFACE_VERSION) {
+        retro::warn(
+            "Expected mic interface version %u, got %u. Compatibility issues are possible.",
+            RETRO_MICROPHONE_INTERFACE_VERSION,
+            interface.interface_version
+        );
+    }
+
+    retro_microphone_params_t params {};
+    params.rate = DS_MIC_SAMPLE_RATE;
+    retro_microphone_t *microphone = interface.open_mic(&params);
+    if (!microphone) {
+        retro::warn("Failed to open the host microphone");
+        return nullptr;
+    }
+
+    return std::make_unique<HostDevice>(interface, microphone);
+#else
+    retro::info("This build of melonDS DS doesn't support host microphones");
+    return nullptr;
+#endif
+}
+
+static std::unique_ptr<melonds::mic::Device> melonds::mic::open_file_device() {
+    std::optional<std::string> path = stand_in_file_path();
+    if (!path)
+        return nullptr;
+
+    // Init has already loaded the file (if it could) for the synthetic file input mode
+    if (_file.Empty()) {
+        retro::warn("Failed to read the stand-in microphone file at \"%s\"", path->c_str());
+        return nullptr;
+    }
+
+    return std::make_unique<FileDevice>(_file);
+}
+
+static std::optional<std::string> melonds::mic::stand_in_file_path() {
+    const std::optional<std::string> &system_directory = retro::get_system_directory();
+    if (!system_directory)
+        return std::nullopt;
+
+    char path[PATH_MAX_LENGTH];
+    fill_pathname_join_special(path, system_directory->c_str(), STAND_IN_FILE_NAME, sizeof(path));
+    if (!path_is_valid(path))
+        return std::nullopt;
+
+    return std::string(path);
+}
+
+// Stretches or squeezes the input to fit the output with linear interpolation.
+static void melonds::mic::resample(const int16_t *input, size_t input_size, int16_t *output, size_t output_size) noexcept {
+    if (input_size == output_size) {
+        memcpy(output, input, output_size * sizeof(int16_t));
+        return;
+    }
+
+    if (input_size == 1 || output_size == 1) {
+        std::fill_n(output, output_size, input[0]);
+        return;
+    }
+
+    // 16.16 fixed point, so the loop has no divisions or float conversions
+    uint64_t step = (static_cast<uint64_t>(input_size - 1) << 16) / (output_size - 1);
+    uint64_t position = 0;
+    for (size_t i = 0; i < output_size; ++i, position += step) {
+        size_t index = std::min<size_t>(position >> 16, input_size - 2);
+        int64_t fraction = static_cast<int64_t>(position - (static_cast<uint64_t>(index) << 16));
+        int64_t a = input[index];
+        int64_t b = input[index + 1];
+        output[i] = static_cast<int16_t>(a + (((b - a) * fraction) >> 16));
+    }
+}
@@ -0,0 +1,72 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_MIC_HPP
+#define MELONDS_DS_MIC_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "input.hpp"
+#include "micsource.hpp"
+
+namespace melonds::mic {
+    /// The sample rate that melonDS expects for microphone input.
+    constexpr unsigned DS_MIC_SAMPLE_RATE = 44100;
+
+    /// The number of samples that NDS::MicInputFrame expects each frame.
+    constexpr std::size_t DS_MIC_SAMPLES_PER_FRAME = 735;
+
+    /// Name of a file in the system directory that's played by the file source,
+    /// and that stands in for the host microphone if the frontend can't provide one.
+    /// Must contain raw signed 16-bit little-endian mono PCM at DS_MIC_SAMPLE_RATE; it's played on a loop.
+    constexpr const char *STAND_IN_FILE_NAME = "melondsds_mic.pcm";
+
+    /// Period of the test tone, in samples; gives 441Hz at DS_MIC_SAMPLE_RATE.
+    constexpr unsigned TONE_PERIOD = 100;
+    constexpr int16_t TONE_AMPLITUDE = 16384;
+
+    /// Everything needed to make the synthetic sources pick up where they left off.
+    /// Stored in savestates so that replays get identical mic input.
+    struct SourceState {
+        uint32_t noise_lanes[NOISE_LANES];
+        uint32_t blow_position;
+        uint32_t tone_position;
+        uint32_t file_position;
+    };
+
+    /// Opens the host microphone (or the stand-in file, if no microphone is available)
+    /// and resets the synthetic sources to their initial state.
+    /// The microphone starts out inactive.
+    void Init();
+
+    /// Closes the host microphone and logs how long it took to produce mic input.
+    void DeInit();
+
+    /// Turns the host microphone on or off.
+    /// Cheap to call every frame; the frontend is only contacted if the state actually changes.
+    void SetActive(bool active);
+
+    /// Feeds exactly one frame's worth of input from the given source to the emulated microphone.
+    /// For the host microphone, that's whatever it captured since the last frame;
+    /// silence is fed if it isn't available or isn't active.
+    void Feed(MicInputMode mode);
+
+    SourceState GetSourceState() noexcept;
+    void SetSourceState(const SourceState &state) noexcept;
+}
+
+#endif //MELONDS_DS_MIC_HPP
@@ -0,0 +1,133 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "micsource.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <streams/file_stream.h>
+#include <types.h>
+#include <frontend/mic_blow.h>
+
+namespace melonds::mic {
+    constexpr double PI = 3.14159265358979323846;
+}
+
+melonds::mic::WhiteNoiseSource::WhiteNoiseSource(uint32_t seed) noexcept {
+    Seed(seed);
+}
+
+void melonds::mic::WhiteNoiseSource::Seed(uint32_t seed) noexcept {
+    for (size_t lane = 0; lane < NOISE_LANES; ++lane) {
+        // Scramble the seed differently for each lane (the finalizer from MurmurHash3)
+        uint32_t x = seed + static_cast<uint32_t>(lane) * 0x9E3779B9u;
+        x ^= x >> 16;
+        x *= 0x85EBCA6Bu;
+        x ^= x >> 13;
+        x *= 0xC2B2AE35u;
+        x ^= x >> 16;
+
+        // xorshift gets stuck at zero forever
+        _lanes[lane] = x ? x : 0xDEADBEEFu;
+    }
+}
+
+void melonds::mic::WhiteNoiseSource::SetLanes(const uint32_t *lanes) noexcept {
+    for (size_t lane = 0; lane < NOISE_LANES; ++lane) {
+        _lanes[lane] = lanes[lane] ? lanes[lane] : 0xDEADBEEFu;
+    }
+}
+
+void melonds::mic::WhiteNoiseSource::Generate(int16_t *output, size_t count) noexcept {
+    int16_t block[NOISE_LANES];
+
+    for (size_t i = 0; i < count; i += NOISE_LANES) {
+        // Every lane is stepped every time, even for a partial block at the end,
+        // so that the sequence only depends on how many blocks were generated
+        for (size_t lane = 0; lane < NOISE_LANES; ++lane) {
+            uint32_t x = _lanes[lane];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            _lanes[lane] = x;
+            block[lane] = static_cast<int16_t>(x >> 16);
+        }
+
+        memcpy(output + i, block, std::min(NOISE_LANES, count - i) * sizeof(int16_t));
+    }
+}
+
+void melonds::mic::TableSource::SetPosition(uint32_t position) noexcept {
+    _position = _table.empty() ? 0 : position % _table.size();
+}
+
+void melonds::mic::TableSource::Generate(int16_t *output, size_t count) noexcept {
+    if (_table.empty()) {
+        memset(output, 0, count * sizeof(int16_t));
+        return;
+    }
+
+    for (size_t written = 0; written < count;) {
+        size_t chunk = std::min(count - written, _table.size() - _position);
+        memcpy(output + written, _table.data() + _position, chunk * sizeof(int16_t));
+        written += chunk;
+        _position = (_position + chunk) % _table.size();
+    }
+}
+
+std::vector<int16_t> melonds::mic::MakeBlowTable() {
+    constexpr size_t length = sizeof(mic_blow) / sizeof(mic_blow[0]);
+    std::vector<int16_t> table(length);
+
+    // The sample is stored as unsigned PCM, which is what Frontend::Mic_FeedNoise converts on every frame
+    for (size_t i = 0; i < length; ++i) {
+        table[i] = static_cast<int16_t>(mic_blow[i] ^ 0x8000);
+    }
+
+    return table;
+}
+
+std::vector<int16_t> melonds::mic::MakeToneTable(unsigned period, int16_t amplitude) {
+    std::vector<int16_t> table(std::max(period, 1u));
+    for (size_t i = 0; i < table.size(); ++i) {
+        double phase = 2.0 * PI * static_cast<double>(i) / static_cast<double>(table.size());
+        table[i] = static_cast<int16_t>(std::lround(amplitude * std::sin(phase)));
+    }
+
+    return table;
+}
+
+std::vector<int16_t> melonds::mic::LoadPcmTable(const char *path) {
+    void *data = nullptr;
+    int64_t length = 0;
+    if (!filestream_read_file(path, &data, &length) || !data) {
+        free(data);
+        return {};
+    }
+
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    std::vector<int16_t> table(static_cast<size_t>(length) / sizeof(int16_t));
+    for (size_t i = 0; i < table.size(); ++i) {
+        // Assembled byte-by-byte so that this works regardless of the host's endianness
+        table[i] = static_cast<int16_t>(bytes[2 * i] | (bytes[2 * i + 1] << 8));
+    }
+
+    free(data);
+    return table;
+}
@@ -0,0 +1,88 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_MICSOURCE_HPP
+#define MELONDS_DS_MICSOURCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace melonds::mic {
+    using std::size_t;
+
+    /// Number of independent generators the white noise source runs side-by-side.
+    /// Chosen so that one step of all lanes fits in a 256-bit vector register.
+    constexpr size_t NOISE_LANES = 8;
+
+    /// The seed that every session starts with, so that replays from boot are reproducible.
+    constexpr uint32_t DEFAULT_NOISE_SEED = 0x6D656C6F; // "melo"
+
+    /// Produces synthetic microphone input without touching the heap or any locks.
+    class Source {
+    public:
+        virtual ~Source() = default;
+
+        /// Fills \c output with the next \c count samples of mono audio.
+        virtual void Generate(int16_t *output, size_t count) noexcept = 0;
+    };
+
+    /// White noise from several xorshift32 generators interleaved across lanes.
+    /// Each lane only depends on itself, so the compiler can vectorize the inner loop.
+    class WhiteNoiseSource final : public Source {
+    public:
+        explicit WhiteNoiseSource(uint32_t seed = DEFAULT_NOISE_SEED) noexcept;
+        void Generate(int16_t *output, size_t count) noexcept override;
+
+        /// Resets every lane to a state derived from \c seed.
+        void Seed(uint32_t seed) noexcept;
+
+        [[nodiscard]] const uint32_t *Lanes() const noexcept { return _lanes; }
+        void SetLanes(const uint32_t *lanes) noexcept;
+
+    private:
+        alignas(32) uint32_t _lanes[NOISE_LANES];
+    };
+
+    /// Plays a precomputed table of samples on a loop.
+    /// Used for blow noise, test tones, and recorded input alike.
+    class TableSource final : public Source {
+    public:
+        TableSource() noexcept = default;
+        explicit TableSource(std::vector<int16_t> &&table) noexcept : _table(std::move(table)) {}
+        void Generate(int16_t *output, size_t count) noexcept override;
+
+        [[nodiscard]] bool Empty() const noexcept { return _table.empty(); }
+        [[nodiscard]] uint32_t Position() const noexcept { return _position; }
+        void SetPosition(uint32_t position) noexcept;
+
+    private:
+        std::vector<int16_t> _table;
+        uint32_t _position = 0;
+    };
+
+    /// Builds a table of blow noise from the sample that ships with melonDS.
+    std::vector<int16_t> MakeBlowTable();
+
+    /// Builds a table holding exactly one period of a sine wave.
+    std::vector<int16_t> MakeToneTable(unsigned period, int16_t amplitude);
+
+    /// Loads raw signed 16-bit little-endian mono PCM from \c path.
+    /// \return An empty table if the file couldn't be read.
+    std::vector<int16_t> LoadPcmTable(const char *path);
+}
+
+#endif //MELONDS_DS_MICSOURCE_HPP
@@ -28,6 +28,7 @@
 #include "input.hpp"
 #include "environment.hpp"
 #include "config.hpp"
+#include "profiler.hpp"
 
 namespace melonds::opengl {
     bool refresh_opengl = true;
@@ -170,6 +171,7 @@ void melonds::opengl::deinitialize() {
 
 static void melonds::opengl::context_reset() {
     retro::log(RETRO_LOG_DEBUG, "melonds::opengl::context_reset()");
+    profiler::Phase phase("OpenGL context reset");
     if (UsingOpenGl() && GPU3D::CurrentRenderer) { // If we're using OpenGL, but there's already a renderer in place...
         retro::log(RETRO_LOG_DEBUG, "GPU3D renderer is assigned; deinitializing it before resetting the context.");
         GPU::DeInitRenderer();
@@ -212,6 +214,7 @@ static void melonds::opengl::context_destroy() {
 
 static bool melonds::opengl::setup_opengl() {
     retro::log(RETRO_LOG_DEBUG, "melonds::opengl::setup_opengl()");
+    profiler::Phase phase("OpenGL shader setup");
 
     if (!OpenGL::BuildShaderProgram(shaders::_vertex_shader, shaders::_fragment_shader, shader, "LibretroShader"))
         return false;
@@ -19,30 +19,39 @@
 #include <file/file_path.h>
 #include <utility>
 #include "../environment.hpp"
+#include "../filecache.hpp"
 #include "../utils.hpp"
 
 FILE *Platform::OpenFile(const std::string& path, const std::string& mode, bool mustexist) {
-    FILE *ret;
-
-    if (mustexist) {
-        ret = fopen(path.c_str(), "rb");
-        if (ret) fclose(ret);
-        ret = fopen(path.c_str(), mode.c_str());
-    } else
-        ret = fopen(path.c_str(), mode.c_str());
+    if (mustexist && !path_is_valid(path.c_str())) {
+        // Checked without opening the file, since mode might create it
+        return nullptr;
+    }
 
-    return ret;
+    return fopen(path.c_str(), mode.c_str());
 }
 
 FILE *Platform::OpenLocalFile(const std::string& path, const std::string& mode) {
+    std::string fullpath;
     if (path_is_absolute(path.c_str())) {
-        return OpenFile(path, mode, true);
+        fullpath = path;
+    } else {
+        std::string directory = retro::get_system_directory().value_or("");
+        fullpath = directory + PLATFORM_DIR_SEPERATOR + path;
+    }
+
+    if (melonds::filecache::IsCacheable(path)) {
+        // If this is a BIOS or firmware image...
+        if (mode == "rb") {
+            if (FILE *cached = melonds::filecache::Open(fullpath))
+                return cached;
+        } else {
+            // melonDS is about to write to it, so the cached copy won't be accurate anymore
+            melonds::filecache::Forget(fullpath);
+        }
     }
 
-    std::string directory = retro::get_system_directory().value_or("");
-    std::string fullpath = directory + PLATFORM_DIR_SEPERATOR + path;
-    FILE* f = OpenFile(fullpath, mode, true);
-    return f;
+    return OpenFile(fullpath, mode, true);
 }
 
 FILE *Platform::OpenDataFile(const std::string& path) {
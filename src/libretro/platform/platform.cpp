@@ -98,7 +98,15 @@ void Platform::Sleep(u64 usecs) {
 
 void Platform::WriteNDSSave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen)
 {
-    // TODO: Implement a Fast SRAM mode where the frontend is given direct access to the SRAM buffer
+    if (melonds::fast_sram_active()) {
+        // The frontend is already looking at the cart's save memory, so there's nothing to copy;
+        // just let it know what changed
+        if (melonds::NdsSaveManager) {
+            melonds::NdsSaveManager->NoteWrite(savelen, writeoffset, writelen);
+        }
+        return;
+    }
+
     if (melonds::NdsSaveManager) {
         melonds::NdsSaveManager->Flush(savedata, savelen, writeoffset, writelen);
 
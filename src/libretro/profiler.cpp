@@ -0,0 +1,235 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "profiler.hpp"
+
+#include <array>
+#include <ctime>
+#include <string>
+
+#include <features/features_cpu.h>
+#include <file/file_path.h>
+#include <formats/rjson.h>
+#include <retro_miscellaneous.h>
+#include <streams/file_stream.h>
+
+#include <frontend/qt_sdl/Config.h>
+
+#include "config.hpp"
+#include "environment.hpp"
+
+namespace melonds::profiler {
+    // More than the number of phases in a load, so that nothing gets dropped
+    constexpr size_t MAX_PHASES = 48;
+    constexpr const char *REPORT_NAME = "melondsds_startup.json";
+
+    struct PhaseRecord {
+        const char *name;
+        retro_time_t start;
+        retro_time_t duration;
+        unsigned depth;
+    };
+
+    static retro_time_t _init_time = 0;
+    static retro_time_t _begin_time = 0;
+    static bool _active = false;
+    static unsigned _depth = 0;
+    static std::array<PhaseRecord, MAX_PHASES> _phases;
+    static size_t _phase_count = 0;
+
+    static void write_report(retro_time_t total) noexcept;
+}
+
+void melonds::profiler::Init() noexcept {
+    _init_time = cpu_features_get_time_usec();
+}
+
+void melonds::profiler::Begin() noexcept {
+    _begin_time = cpu_features_get_time_usec();
+    _active = true;
+    _depth = 0;
+    _phase_count = 0;
+}
+
+bool melonds::profiler::Active() noexcept {
+    return _active;
+}
+
+void melonds::profiler::Record(const char *name, retro_time_t start, retro_time_t duration) noexcept {
+    if (!_active || _phase_count >= MAX_PHASES)
+        return;
+
+    _phases[_phase_count++] = {name, start - _begin_time, duration, _depth};
+}
+
+melonds::profiler::Phase::Phase(const char *name) noexcept :
+    _start(cpu_features_get_time_usec()),
+    _index(NO_INDEX) {
+    if (!_active || _phase_count >= MAX_PHASES)
+        return;
+
+    // Reserved now so that the report lists phases in the order they started
+    _index = _phase_count++;
+    _phases[_index] = {name, _start - _begin_time, 0, _depth};
+    _depth++;
+}
+
+melonds::profiler::Phase::~Phase() noexcept {
+    if (!_active || _index == NO_INDEX)
+        return;
+
+    _phases[_index].duration = cpu_features_get_time_usec() - _start;
+    _depth--;
+}
+
+void melonds::profiler::Finish() noexcept {
+    if (!_active)
+        return;
+
+    _active = false;
+    retro_time_t total = cpu_features_get_time_usec() - _begin_time;
+
+    std::string summary;
+    for (size_t i = 0; i < _phase_count; ++i) {
+        const PhaseRecord &phase = _phases[i];
+        char entry[128];
+        snprintf(entry, sizeof(entry), "%s%*s%s %.1fms", i ? ", " : "", static_cast<int>(phase.depth), "", phase.name, phase.duration / 1000.0);
+        summary += entry;
+    }
+
+    retro::info(
+        "Startup took %.1fms from retro_load_game to the first frame (%.1fms after retro_init): %s",
+        total / 1000.0,
+        _init_time ? (_begin_time - _init_time + total) / 1000.0 : 0.0,
+        summary.c_str()
+    );
+
+    if (Config::Retro::StartupReport) {
+        write_report(total);
+    }
+}
+
+static void melonds::profiler::write_report(retro_time_t total) noexcept {
+    const std::optional<std::string> &save_directory = retro::get_save_directory();
+    if (!save_directory) {
+        retro::warn("No save directory available, not writing the startup report");
+        return;
+    }
+
+    char path[PATH_MAX_LENGTH];
+    fill_pathname_join_special(path, save_directory->c_str(), REPORT_NAME, sizeof(path));
+
+    RFILE *file = filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+    if (!file) {
+        retro::warn("Failed to open \"%s\" for the startup report", path);
+        return;
+    }
+
+    rjsonwriter_t *writer = rjsonwriter_open_rfile(file);
+    if (!writer) {
+        filestream_close(file);
+        return;
+    }
+
+    rjsonwriter_add_start_object(writer);
+    rjsonwriter_add_newline(writer);
+
+    rjsonwriter_add_spaces(writer, 2);
+    rjsonwriter_add_string(writer, "timestamp");
+    rjsonwriter_add_colon(writer);
+    rjsonwriter_add_space(writer);
+    rjsonwriter_add_double(writer, static_cast<double>(time(nullptr)));
+    rjsonwriter_add_comma(writer);
+    rjsonwriter_add_newline(writer);
+
+    rjsonwriter_add_spaces(writer, 2);
+    rjsonwriter_add_string(writer, "console");
+    rjsonwriter_add_colon(writer);
+    rjsonwriter_add_space(writer);
+    rjsonwriter_add_string(writer, Config::ConsoleType == ConsoleType::DSi ? "dsi" : "ds");
+    rjsonwriter_add_comma(writer);
+    rjsonwriter_add_newline(writer);
+
+    rjsonwriter_add_spaces(writer, 2);
+    rjsonwriter_add_string(writer, "renderer");
+    rjsonwriter_add_colon(writer);
+    rjsonwriter_add_space(writer);
+    rjsonwriter_add_string(writer, Config::Retro::CurrentRenderer == Renderer::OpenGl ? "opengl" : "software");
+    rjsonwriter_add_comma(writer);
+    rjsonwriter_add_newline(writer);
+
+    rjsonwriter_add_spaces(writer, 2);
+    rjsonwriter_add_string(writer, "init_to_load_ms");
+    rjsonwriter_add_colon(writer);
+    rjsonwriter_add_space(writer);
+    rjsonwriter_add_double(writer, _init_time ? (_begin_time - _init_time) / 1000.0 : 0.0);
+    rjsonwriter_add_comma(writer);
+    rjsonwriter_add_newline(writer);
+
+    rjsonwriter_add_spaces(writer, 2);
+    rjsonwriter_add_string(writer, "load_to_first_frame_ms");
+    rjsonwriter_add_colon(writer);
+    rjsonwriter_add_space(writer);
+    rjsonwriter_add_double(writer, total / 1000.0);
+    rjsonwriter_add_comma(writer);
+    rjsonwriter_add_newline(writer);
+
+    rjsonwriter_add_spaces(writer, 2);
+    rjsonwriter_add_string(writer, "phases");
+    rjsonwriter_add_colon(writer);
+    rjsonwriter_add_space(writer);
+    rjsonwriter_add_start_array(writer);
+    rjsonwriter_add_newline(writer);
+    for (size_t i = 0; i < _phase_count; ++i) {
+        const PhaseRecord &phase = _phases[i];
+        rjsonwriter_add_spaces(writer, 4);
+        rjsonwriter_add_start_object(writer);
+        rjsonwriter_add_string(writer, "name");
+        rjsonwriter_add_colon(writer);
+        rjsonwriter_add_string(writer, phase.name);
+        rjsonwriter_add_comma(writer);
+        rjsonwriter_add_string(writer, "depth");
+        rjsonwriter_add_colon(writer);
+        rjsonwriter_add_unsigned(writer, phase.depth);
+        rjsonwriter_add_comma(writer);
+        rjsonwriter_add_string(writer, "start_ms");
+        rjsonwriter_add_colon(writer);
+        rjsonwriter_add_double(writer, phase.start / 1000.0);
+        rjsonwriter_add_comma(writer);
+        rjsonwriter_add_string(writer, "duration_ms");
+        rjsonwriter_add_colon(writer);
+        rjsonwriter_add_double(writer, phase.duration / 1000.0);
+        rjsonwriter_add_end_object(writer);
+        if (i + 1 < _phase_count)
+            rjsonwriter_add_comma(writer);
+        rjsonwriter_add_newline(writer);
+    }
+    rjsonwriter_add_spaces(writer, 2);
+    rjsonwriter_add_end_array(writer);
+    rjsonwriter_add_newline(writer);
+
+    rjsonwriter_add_end_object(writer);
+    rjsonwriter_add_newline(writer);
+
+    // Also flushes the writer's buffer to the file
+    if (!rjsonwriter_free(writer)) {
+        retro::warn("Failed to write the startup report to \"%s\"", path);
+    } else {
+        retro::debug("Wrote the startup report to \"%s\"", path);
+    }
+
+    filestream_close(file);
+}
@@ -0,0 +1,66 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_PROFILER_HPP
+#define MELONDS_DS_PROFILER_HPP
+
+#include <cstddef>
+
+#include <libretro.h>
+
+/// Measures where the time goes between retro_load_game and the first presented frame.
+/// Phases are only recorded from the frontend's thread, and only while a load is in progress;
+/// everything here is a no-op otherwise.
+namespace melonds::profiler {
+    /// Remembers when retro_init was called, so the gap before retro_load_game can be reported.
+    void Init() noexcept;
+
+    /// Forgets the previous load's phases and starts recording new ones.
+    void Begin() noexcept;
+
+    /// Records a phase that was measured elsewhere (e.g. by a Task on another thread).
+    void Record(const char *name, retro_time_t start, retro_time_t duration) noexcept;
+
+    /// Stops recording, logs a one-line summary, and writes a JSON report to the save directory if enabled.
+    /// Call once the first frame has been presented.
+    void Finish() noexcept;
+
+    /// True between Begin and Finish.
+    bool Active() noexcept;
+
+    /// Records the time between its construction and destruction as a phase.
+    /// Phases can be nested.
+    class Phase {
+    public:
+        /// \param name Must outlive the profiler's report; a string literal is best.
+        explicit Phase(const char *name) noexcept;
+
+        ~Phase() noexcept;
+
+        Phase(const Phase &) = delete;
+
+        Phase &operator=(const Phase &) = delete;
+
+    private:
+        retro_time_t _start;
+
+        // Where this phase is in the report, or NO_INDEX if it isn't being recorded
+        std::size_t _index;
+        static constexpr std::size_t NO_INDEX = ~std::size_t(0);
+    };
+}
+
+#endif //MELONDS_DS_PROFILER_HPP
@@ -0,0 +1,471 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "quicksave.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <compat/strl.h>
+#include <file/file_path.h>
+#include <formats/rbmp.h>
+#include <retro_miscellaneous.h>
+#include <streams/file_stream.h>
+#include <streams/rzip_stream.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include <GPU.h>
+#include <NDS.h>
+#include <Savestate.h>
+#include <frontend/qt_sdl/Config.h>
+
+#include "atomicfile.hpp"
+#include "config.hpp"
+#include "content.hpp"
+#include "environment.hpp"
+#include "timing.hpp"
+
+namespace melonds::quicksave {
+    constexpr unsigned SCREEN_WIDTH = 256;
+    constexpr unsigned SCREEN_HEIGHT = 192;
+    constexpr unsigned THUMBNAIL_WIDTH = SCREEN_WIDTH / THUMBNAIL_SCALE;
+    constexpr unsigned THUMBNAIL_HEIGHT = (SCREEN_HEIGHT * 2) / THUMBNAIL_SCALE;
+
+    // One slot can be written in the background while the other captures a new quick save
+    constexpr size_t SLOT_COUNT = 2;
+
+    enum class SlotStatus {
+        Free,
+        Queued,
+        Writing,
+        Done,
+    };
+
+    /// Everything the background writer needs to finish a quick save.
+    /// The buffers are allocated once and reused for every quick save.
+    struct Slot {
+        SlotStatus status = SlotStatus::Free;
+        bool succeeded = false;
+        std::vector<u8> state;
+        u32 state_length = 0;
+        std::vector<u32> frame; // Both screens, stacked vertically
+        bool has_frame = false;
+        std::vector<u32> thumbnail;
+    };
+
+    static bool _enabled = false;
+    static std::string _state_path;
+    static std::string _thumbnail_path;
+    static Slot _slots[SLOT_COUNT];
+
+    static TimingStats _capture_timing;
+    static TimingStats _write_timing;
+    static TimingStats _load_timing;
+
+#ifdef HAVE_THREADS
+    static sthread_t *_worker = nullptr;
+    static slock_t *_lock = nullptr;
+    static scond_t *_condition = nullptr;
+    static bool _stopping = false;
+
+    static void worker_main(void *);
+#endif
+
+    static bool capture_state(Slot &slot);
+    static void capture_frame(Slot &slot) noexcept;
+    static void write_thumbnail(Slot &slot) noexcept;
+    static bool write_slot(Slot &slot) noexcept;
+    static void wait_for_writes() noexcept;
+    static void lock() noexcept;
+    static void unlock() noexcept;
+}
+
+void melonds::quicksave::Init() {
+    _enabled = false;
+    _state_path.clear();
+    _thumbnail_path.clear();
+    _capture_timing.Reset();
+    _write_timing.Reset();
+    _load_timing.Reset();
+
+    const std::optional<std::string> &save_directory = retro::get_save_directory();
+    const std::optional<struct retro_game_info> &nds_info = retro::content::get_loaded_nds_info();
+    if (!save_directory || !nds_info || !nds_info->path) {
+        retro::debug("No save directory or game path available, quick saves are disabled");
+        return;
+    }
+
+    char game_name[PATH_MAX_LENGTH];
+    const char *ptr = path_basename(nds_info->path);
+    strlcpy(game_name, ptr ? ptr : nds_info->path, sizeof(game_name));
+    path_remove_extension(game_name);
+
+    char path[PATH_MAX_LENGTH];
+    fill_pathname_join_special(path, save_directory->c_str(), game_name, sizeof(path));
+    _state_path = std::string(path) + ".quick.state";
+    _thumbnail_path = std::string(path) + ".quick.bmp";
+
+    for (Slot &slot : _slots) {
+        slot.status = SlotStatus::Free;
+        slot.frame.resize(SCREEN_WIDTH * SCREEN_HEIGHT * 2);
+        slot.thumbnail.resize(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT);
+    }
+
+#ifdef HAVE_THREADS
+    _stopping = false;
+    _lock = slock_new();
+    _condition = scond_new();
+    _worker = sthread_create(worker_main, nullptr);
+    if (!_lock || !_condition || !_worker) {
+        retro::error("Failed to start the quick save writer thread, quick saves are disabled");
+        DeInit();
+        return;
+    }
+#endif
+
+    _enabled = true;
+    retro::debug("Quick saves will be written to \"%s\"", _state_path.c_str());
+}
+
+void melonds::quicksave::DeInit() {
+#ifdef HAVE_THREADS
+    if (_worker) {
+        // Whatever's still queued is written before the worker exits
+        slock_lock(_lock);
+        _stopping = true;
+        scond_broadcast(_condition);
+        slock_unlock(_lock);
+
+        sthread_join(_worker);
+        _worker = nullptr;
+    }
+
+    if (_condition) {
+        scond_free(_condition);
+        _condition = nullptr;
+    }
+
+    if (_lock) {
+        slock_free(_lock);
+        _lock = nullptr;
+    }
+#endif
+
+    if (_capture_timing.Count() > 0) {
+        retro::info(
+            "Quick saves stalled emulation for %.1fus on average (max %lldus); writing them took %.1fms on average (max %.1fms)",
+            _capture_timing.Average(),
+            static_cast<long long>(_capture_timing.Max()),
+            _write_timing.Average() / 1000.0,
+            _write_timing.Max() / 1000.0
+        );
+    }
+
+    if (_load_timing.Count() > 0) {
+        retro::info(
+            "Quick loads took %.1fms on average (max %.1fms)",
+            _load_timing.Average() / 1000.0,
+            _load_timing.Max() / 1000.0
+        );
+    }
+
+    for (Slot &slot : _slots) {
+        slot = Slot();
+    }
+
+    _enabled = false;
+}
+
+void melonds::quicksave::Save() {
+    if (!_enabled)
+        return;
+
+    if (Config::ConsoleType == ConsoleType::DSi) {
+        retro::set_warn_message("Quick saves aren't supported in DSi mode.");
+        return;
+    }
+
+    Slot *slot = nullptr;
+    lock();
+    for (Slot &s : _slots) {
+        if (s.status == SlotStatus::Free) {
+            slot = &s;
+            break;
+        }
+    }
+    unlock();
+
+    if (!slot) {
+        // If every slot is still being written...
+        retro::set_warn_message("Still writing the previous quick save, try again in a moment.");
+        return;
+    }
+
+    {
+        ScopedTimer timer(_capture_timing);
+        if (!capture_state(*slot)) {
+            retro::set_error_message("Failed to capture the quick save.");
+            return;
+        }
+
+        capture_frame(*slot);
+    }
+
+#ifdef HAVE_THREADS
+    slock_lock(_lock);
+    slot->status = SlotStatus::Queued;
+    scond_broadcast(_condition);
+    slock_unlock(_lock);
+#else
+    // Without threads, the best we can do is write it right away
+    slot->succeeded = write_slot(*slot);
+    slot->status = SlotStatus::Done;
+    Update();
+#endif
+}
+
+void melonds::quicksave::Load() {
+    if (!_enabled)
+        return;
+
+    if (Config::ConsoleType == ConsoleType::DSi) {
+        retro::set_warn_message("Quick saves aren't supported in DSi mode.");
+        return;
+    }
+
+    // Make sure we load the most recent quick save, not whatever was on disk before it
+    wait_for_writes();
+    Update();
+
+    ScopedTimer timer(_load_timing);
+    rzipstream_t *file = rzipstream_open(_state_path.c_str(), RETRO_VFS_FILE_ACCESS_READ);
+    if (!file) {
+        retro::set_warn_message("No quick save to load.");
+        return;
+    }
+
+    // rzipstream reports the uncompressed size and inflates as it reads,
+    // so the state goes straight from the file into the buffer in one pass
+    int64_t length = rzipstream_get_size(file);
+
+    // Every slot is free now, so we can borrow one's buffer
+    std::vector<u8> &buffer = _slots[0].state;
+    if (length > 0) {
+        buffer.resize(length);
+    }
+
+    int64_t bytes_read = length > 0 ? rzipstream_read(file, buffer.data(), length) : -1;
+    rzipstream_close(file);
+
+    if (bytes_read != length) {
+        retro::error("Failed to read quick save from \"%s\"", _state_path.c_str());
+        retro::set_error_message("Failed to read the quick save.");
+        return;
+    }
+
+    Savestate state(buffer.data(), length, false);
+    if (!NDS::DoSavestate(&state) || state.Error) {
+        retro::set_error_message("Failed to load the quick save.");
+        return;
+    }
+
+    retro::info("Loaded quick save from \"%s\"", _state_path.c_str());
+}
+
+void melonds::quicksave::Update() {
+    if (!_enabled)
+        return;
+
+    lock();
+    for (Slot &slot : _slots) {
+        if (slot.status != SlotStatus::Done)
+            continue;
+
+        if (slot.succeeded) {
+            retro::info("Wrote quick save to \"%s\"", _state_path.c_str());
+        } else {
+            retro::set_error_message("Failed to write the quick save.");
+        }
+        slot.status = SlotStatus::Free;
+    }
+    unlock();
+}
+
+static bool melonds::quicksave::capture_state(Slot &slot) {
+    if (slot.state.empty()) {
+        // If this is the first quick save, find out how big the state is
+        Savestate state;
+        if (!NDS::DoSavestate(&state) || state.Error)
+            return false;
+
+        slot.state.resize(state.Length());
+    }
+
+    {
+        Savestate state(slot.state.data(), slot.state.size(), true);
+        if (!NDS::DoSavestate(&state) || state.Error)
+            return false;
+
+        slot.state_length = state.Length();
+    } // melonDS finishes writing the savestate's header when it's destroyed
+
+    return true;
+}
+
+static void melonds::quicksave::capture_frame(Slot &slot) noexcept {
+    // The OpenGL renderer draws 3D straight into its own framebuffer, so GPU::Framebuffer doesn't have the real frame.
+    // Reading the GL framebuffer back would stall the pipeline, so those quick saves just go without a thumbnail.
+    slot.has_frame = Config::Retro::CurrentRenderer != Renderer::OpenGl;
+    if (!slot.has_frame)
+        return;
+
+    // Just a copy; the thumbnail is scaled down on the worker
+    int frontbuf = GPU::FrontBuffer;
+    constexpr size_t screen_size = SCREEN_WIDTH * SCREEN_HEIGHT;
+    memcpy(slot.frame.data(), GPU::Framebuffer[frontbuf][0], screen_size * sizeof(u32));
+    memcpy(slot.frame.data() + screen_size, GPU::Framebuffer[frontbuf][1], screen_size * sizeof(u32));
+}
+
+static bool melonds::quicksave::write_slot(Slot &slot) noexcept {
+    ScopedTimer timer(_write_timing);
+
+    if (slot.has_frame) {
+        write_thumbnail(slot);
+    } else if (path_is_valid(_thumbnail_path.c_str())) {
+        // Don't leave an older quick save's thumbnail next to this one
+        filestream_delete(_thumbnail_path.c_str());
+    }
+
+    // Write to a temporary file first so that a crash mid-write doesn't destroy the previous quick save
+    std::string temp_path = _state_path + ".tmp";
+#ifdef HAVE_ZLIB
+    bool written = rzipstream_write_file(temp_path.c_str(), slot.state.data(), slot.state_length);
+#else
+    bool written = filestream_write_file(temp_path.c_str(), slot.state.data(), slot.state_length);
+#endif
+    if (!written) {
+        retro::error("Failed to write quick save to \"%s\"", temp_path.c_str());
+        filestream_delete(temp_path.c_str());
+        return false;
+    }
+
+    if (!RenameOver(temp_path.c_str(), _state_path.c_str())) {
+        retro::error("Failed to move quick save from \"%s\" to \"%s\"", temp_path.c_str(), _state_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+static void melonds::quicksave::write_thumbnail(Slot &slot) noexcept {
+    // Box filter; each thumbnail pixel is the average of a THUMBNAIL_SCALE x THUMBNAIL_SCALE block
+    for (unsigned y = 0; y < THUMBNAIL_HEIGHT; ++y) {
+        for (unsigned x = 0; x < THUMBNAIL_WIDTH; ++x) {
+            u32 r = 0, g = 0, b = 0;
+            for (unsigned dy = 0; dy < THUMBNAIL_SCALE; ++dy) {
+                const u32 *row = slot.frame.data() + (y * THUMBNAIL_SCALE + dy) * SCREEN_WIDTH;
+                for (unsigned dx = 0; dx < THUMBNAIL_SCALE; ++dx) {
+                    u32 pixel = row[x * THUMBNAIL_SCALE + dx];
+                    r += (pixel >> 16) & 0xFF;
+                    g += (pixel >> 8) & 0xFF;
+                    b += pixel & 0xFF;
+                }
+            }
+
+            constexpr unsigned samples = THUMBNAIL_SCALE * THUMBNAIL_SCALE;
+            slot.thumbnail[y * THUMBNAIL_WIDTH + x] = ((r / samples) << 16) | ((g / samples) << 8) | (b / samples);
+        }
+    }
+
+    if (!rbmp_save_image(
+        _thumbnail_path.c_str(),
+        slot.thumbnail.data(),
+        THUMBNAIL_WIDTH,
+        THUMBNAIL_HEIGHT,
+        THUMBNAIL_WIDTH * sizeof(u32),
+        RBMP_SOURCE_TYPE_XRGB888
+    )) {
+        // Not fatal; the state itself is what matters
+        retro::warn("Failed to write quick save thumbnail to \"%s\"", _thumbnail_path.c_str());
+    }
+}
+
+#ifdef HAVE_THREADS
+static void melonds::quicksave::worker_main(void *) {
+    slock_lock(_lock);
+    while (true) {
+        Slot *slot = nullptr;
+        for (Slot &s : _slots) {
+            if (s.status == SlotStatus::Queued) {
+                slot = &s;
+                break;
+            }
+        }
+
+        if (!slot) {
+            if (_stopping)
+                break;
+
+            scond_wait(_condition, _lock);
+            continue;
+        }
+
+        slot->status = SlotStatus::Writing;
+        slock_unlock(_lock);
+
+        bool succeeded = write_slot(*slot);
+
+        slock_lock(_lock);
+        slot->succeeded = succeeded;
+        slot->status = SlotStatus::Done;
+        scond_broadcast(_condition);
+    }
+    slock_unlock(_lock);
+}
+#endif
+
+static void melonds::quicksave::wait_for_writes() noexcept {
+#ifdef HAVE_THREADS
+    slock_lock(_lock);
+    while (true) {
+        bool pending = false;
+        for (const Slot &s : _slots) {
+            pending |= s.status == SlotStatus::Queued || s.status == SlotStatus::Writing;
+        }
+
+        if (!pending)
+            break;
+
+        scond_wait(_condition, _lock);
+    }
+    slock_unlock(_lock);
+#endif
+}
+
+static void melonds::quicksave::lock() noexcept {
+#ifdef HAVE_THREADS
+    slock_lock(_lock);
+#endif
+}
+
+static void melonds::quicksave::unlock() noexcept {
+#ifdef HAVE_THREADS
+    slock_unlock(_lock);
+#endif
+}
@@ -0,0 +1,46 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_QUICKSAVE_HPP
+#define MELONDS_DS_QUICKSAVE_HPP
+
+namespace melonds::quicksave {
+    /// The thumbnail is both screens stacked vertically, scaled down by this factor.
+    constexpr unsigned THUMBNAIL_SCALE = 2;
+
+    /// Decides where quick saves go for the loaded game and starts the background writer.
+    /// Quick saves are disabled if the frontend didn't provide a save directory.
+    void Init();
+
+    /// Waits for any pending quick save to finish writing, then stops the background writer
+    /// and logs how long quick saves took.
+    void DeInit();
+
+    /// Captures the emulator's state and the current frame,
+    /// then hands them off to be compressed and written in the background.
+    /// Should be called between frames.
+    void Save();
+
+    /// Waits for any pending quick save to finish writing, then loads it.
+    /// Should be called between frames.
+    void Load();
+
+    /// Reports quick saves that finished writing since the last call.
+    /// Call once per frame on the emulation thread.
+    void Update();
+}
+
+#endif //MELONDS_DS_QUICKSAVE_HPP
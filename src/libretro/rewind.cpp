@@ -0,0 +1,448 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "rewind.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <NDS.h>
+#include <Savestate.h>
+#include <frontend/qt_sdl/Config.h>
+
+#include "config.hpp"
+#include "environment.hpp"
+#include "timing.hpp"
+
+/// Rewinding works with backward deltas.
+/// We keep the most recent snapshot in full, plus a chain of deltas that each turn
+/// a snapshot into the one before it. Each delta is the XOR of the changed pages
+/// of two consecutive snapshots, run-length encoded (most of the XOR is zero).
+///
+/// A delta record is a sequence of page entries:
+///     u32 page index
+///     u32 encoded length
+///     tokens: (u16 unchanged byte count, u16 changed byte count, changed bytes XOR'd)...
+namespace melonds::rewind {
+    // Each page entry's fixed-size header
+    constexpr size_t PAGE_HEADER_SIZE = sizeof(uint32_t) * 2;
+
+    // Each run-length token's fixed-size header
+    constexpr size_t TOKEN_HEADER_SIZE = sizeof(uint16_t) * 2;
+
+    /// A circular buffer of variable-length records.
+    /// Records can be added at the front, taken from the front, or dropped from the back.
+    /// Each record is stored as [u32 length][data][u32 length] so it can be walked from either end.
+    class DeltaRing {
+    public:
+        void Reset(size_t capacity) {
+            _buffer.assign(capacity, 0);
+            _head = 0;
+            _used = 0;
+            _count = 0;
+        }
+
+        void Free() {
+            _buffer.clear();
+            _buffer.shrink_to_fit();
+            _head = 0;
+            _used = 0;
+            _count = 0;
+        }
+
+        /// Adds a record, dropping the oldest ones until it fits.
+        /// \return \c false if the record is larger than the entire buffer.
+        bool Push(const uint8_t *data, uint32_t length) {
+            size_t needed = length + sizeof(uint32_t) * 2;
+            if (needed > _buffer.size())
+                return false;
+
+            while (_buffer.size() - _used < needed) {
+                DropOldest();
+            }
+
+            write(_head, &length, sizeof(length));
+            write(_head + sizeof(length), data, length);
+            write(_head + sizeof(length) + length, &length, sizeof(length));
+            _head = (_head + needed) % _buffer.size();
+            _used += needed;
+            _count++;
+            return true;
+        }
+
+        /// Removes the newest record and copies it into \c output.
+        /// \return \c false if there are no records.
+        bool PopNewest(std::vector<uint8_t> &output) {
+            if (_count == 0)
+                return false;
+
+            uint32_t length = 0;
+            size_t footer = (_head + _buffer.size() - sizeof(length)) % _buffer.size();
+            read(footer, &length, sizeof(length));
+
+            size_t needed = length + sizeof(uint32_t) * 2;
+            size_t start = (_head + _buffer.size() - needed) % _buffer.size();
+            output.resize(length);
+            read(start + sizeof(length), output.data(), length);
+
+            _head = start;
+            _used -= needed;
+            _count--;
+            return true;
+        }
+
+        [[nodiscard]] size_t Count() const noexcept { return _count; }
+        [[nodiscard]] size_t Used() const noexcept { return _used; }
+        [[nodiscard]] size_t Capacity() const noexcept { return _buffer.size(); }
+
+    private:
+        void DropOldest() {
+            size_t tail = (_head + _buffer.size() - _used) % _buffer.size();
+            uint32_t length = 0;
+            read(tail, &length, sizeof(length));
+            _used -= length + sizeof(uint32_t) * 2;
+            _count--;
+        }
+
+        void write(size_t offset, const void *data, size_t length) {
+            offset %= _buffer.size();
+            size_t first = std::min(length, _buffer.size() - offset);
+            memcpy(&_buffer[offset], data, first);
+            memcpy(&_buffer[0], static_cast<const uint8_t *>(data) + first, length - first);
+        }
+
+        void read(size_t offset, void *data, size_t length) const {
+            offset %= _buffer.size();
+            size_t first = std::min(length, _buffer.size() - offset);
+            memcpy(data, &_buffer[offset], first);
+            memcpy(static_cast<uint8_t *>(data) + first, &_buffer[0], length - first);
+        }
+
+        std::vector<uint8_t> _buffer;
+        size_t _head = 0; // Where the next record will be written
+        size_t _used = 0;
+        size_t _count = 0;
+    };
+
+    static DeltaRing _deltas;
+
+    // The most recent snapshot, in full
+    static std::vector<uint8_t> _latest;
+
+    // Scratch space for the next snapshot
+    static std::vector<uint8_t> _scratch;
+
+    // Scratch space for encoding and decoding deltas
+    static std::vector<uint8_t> _delta;
+
+    static size_t _state_size = 0;
+    static bool _has_snapshot = false;
+    static unsigned _frames_since_snapshot = 0;
+
+    static TimingStats _snapshot_timing;
+    static TimingStats _step_back_timing;
+    static uint64_t _total_delta_bytes = 0;
+
+    static bool serialize_into(std::vector<uint8_t> &buffer);
+    static size_t encode_delta(const uint8_t *older, const uint8_t *newer, size_t size, uint8_t *output) noexcept;
+    static size_t encode_page(const uint8_t *older, const uint8_t *newer, size_t length, uint8_t *output) noexcept;
+    static void apply_delta(const uint8_t *delta, size_t delta_length, uint8_t *state, size_t size) noexcept;
+}
+
+void melonds::rewind::Init() {
+    _deltas.Free();
+    _latest.clear();
+    _scratch.clear();
+    _delta.clear();
+    _state_size = 0;
+    _has_snapshot = false;
+    _frames_since_snapshot = 0;
+    _snapshot_timing.Reset();
+    _step_back_timing.Reset();
+    _total_delta_bytes = 0;
+
+    if (!Config::Retro::RewindEnabled)
+        return;
+
+    if (Config::ConsoleType == ConsoleType::DSi) {
+        // DSi mode doesn't support savestates right now
+        retro::warn("Rewinding isn't supported in DSi mode");
+        return;
+    }
+
+    retro::info(
+        "Rewinding enabled with a %zu MiB budget, taking a snapshot every %u frame(s)",
+        Config::Retro::RewindBudget / (1024 * 1024),
+        Config::Retro::RewindInterval
+    );
+}
+
+void melonds::rewind::DeInit() {
+    if (_snapshot_timing.Count() > 0) {
+        RewindStats stats = Stats();
+        retro::info(
+            "Rewind buffer held %zu snapshots in %.1f MiB of its %.1f MiB budget (%.1f KiB per snapshot on average)",
+            stats.snapshots,
+            stats.used_bytes / 1024.0 / 1024.0,
+            stats.budget_bytes / 1024.0 / 1024.0,
+            _total_delta_bytes / 1024.0 / _snapshot_timing.Count()
+        );
+        retro::info(
+            "Rewind snapshots took %.1fus on average (min %lldus, max %lldus, %llu snapshots)",
+            _snapshot_timing.Average(),
+            static_cast<long long>(_snapshot_timing.Min()),
+            static_cast<long long>(_snapshot_timing.Max()),
+            static_cast<unsigned long long>(_snapshot_timing.Count())
+        );
+    }
+
+    if (_step_back_timing.Count() > 0) {
+        retro::info(
+            "Rewinding took %.1fus per step on average (min %lldus, max %lldus, %llu steps)",
+            _step_back_timing.Average(),
+            static_cast<long long>(_step_back_timing.Min()),
+            static_cast<long long>(_step_back_timing.Max()),
+            static_cast<unsigned long long>(_step_back_timing.Count())
+        );
+    }
+
+    _deltas.Free();
+    _latest = std::vector<uint8_t>();
+    _scratch = std::vector<uint8_t>();
+    _delta = std::vector<uint8_t>();
+    _state_size = 0;
+    _has_snapshot = false;
+}
+
+void melonds::rewind::Clear() {
+    if (_deltas.Capacity() > 0) {
+        _deltas.Reset(_deltas.Capacity());
+    }
+    _has_snapshot = false;
+    _frames_since_snapshot = 0;
+}
+
+void melonds::rewind::Snapshot() {
+    if (!Config::Retro::RewindEnabled || Config::ConsoleType == ConsoleType::DSi)
+        return;
+
+    if (++_frames_since_snapshot < Config::Retro::RewindInterval)
+        return;
+
+    _frames_since_snapshot = 0;
+    ScopedTimer timer(_snapshot_timing);
+
+    if (!_has_snapshot) {
+        // If this is the first snapshot (or the history was discarded)...
+        // Measure the savestate again, in case it's grown since the last time
+        _latest.clear();
+        if (!serialize_into(_latest)) {
+            retro::warn("Failed to take a rewind snapshot; will try again next time");
+            return;
+        }
+
+        _state_size = _latest.size();
+        _scratch.resize(_state_size);
+
+        // A delta can't be bigger than every page stored verbatim, plus its headers
+        size_t pages = (_state_size + REWIND_PAGE_SIZE - 1) / REWIND_PAGE_SIZE;
+        _delta.resize(pages * (REWIND_PAGE_SIZE + PAGE_HEADER_SIZE + TOKEN_HEADER_SIZE));
+
+        if (_deltas.Capacity() != Config::Retro::RewindBudget) {
+            _deltas.Reset(Config::Retro::RewindBudget);
+        }
+
+        _has_snapshot = true;
+        return;
+    }
+
+    if (!serialize_into(_scratch)) {
+        // If the savestate outgrew the buffer we sized for it (or melonDS failed to save it)...
+        retro::warn("Failed to take a rewind snapshot; discarding rewind history");
+        Clear();
+        return;
+    }
+
+    if (_scratch.size() != _state_size) {
+        // If the savestate changed size (e.g. a different cart was inserted)...
+        retro::warn("Savestate size changed from %zu to %zu bytes; discarding rewind history", _state_size, _scratch.size());
+        Clear();
+        return;
+    }
+
+    // The delta turns the new snapshot back into the previous one
+    size_t delta_length = encode_delta(_latest.data(), _scratch.data(), _state_size, _delta.data());
+    if (!_deltas.Push(_delta.data(), delta_length)) {
+        // If this one delta is bigger than the entire budget...
+        retro::warn("Rewind snapshot (%zu bytes) doesn't fit in the rewind budget; discarding rewind history", delta_length);
+        _deltas.Reset(_deltas.Capacity());
+    }
+
+    _total_delta_bytes += delta_length;
+    std::swap(_latest, _scratch);
+}
+
+bool melonds::rewind::StepBack() {
+    if (!Config::Retro::RewindEnabled || !_has_snapshot)
+        return false;
+
+    ScopedTimer timer(_step_back_timing);
+
+    if (_deltas.PopNewest(_delta)) {
+        // If there's an earlier snapshot to go back to...
+        apply_delta(_delta.data(), _delta.size(), _latest.data(), _state_size);
+
+        // Restore the delta scratch buffer's full size for the next encode
+        _delta.resize(_delta.capacity());
+    }
+    // Otherwise we stay at the oldest snapshot we have
+
+    _frames_since_snapshot = 0;
+    Savestate state(_latest.data(), _state_size, false);
+    return NDS::DoSavestate(&state) && !state.Error;
+}
+
+melonds::rewind::RewindStats melonds::rewind::Stats() {
+    return RewindStats {
+        .snapshots = _deltas.Count(),
+        .used_bytes = _deltas.Used(),
+        .budget_bytes = _deltas.Capacity(),
+    };
+}
+
+static bool melonds::rewind::serialize_into(std::vector<uint8_t> &buffer) {
+    if (buffer.empty()) {
+        // If we don't know how big the savestate is yet, let melonDS allocate as it goes
+        Savestate state;
+        if (!NDS::DoSavestate(&state) || state.Error)
+            return false;
+
+        // Measure first, copy afterwards, so the length includes everything melonDS wrote
+        buffer.resize(state.Length());
+    }
+
+    u32 length = 0;
+    {
+        Savestate state(buffer.data(), buffer.size(), true);
+        if (!NDS::DoSavestate(&state) || state.Error)
+            return false;
+
+        length = state.Length();
+    } // melonDS finishes writing the savestate's header when it's destroyed
+
+    buffer.resize(length);
+    return true;
+}
+
+static size_t melonds::rewind::encode_delta(const uint8_t *older, const uint8_t *newer, size_t size, uint8_t *output) noexcept {
+    size_t written = 0;
+    for (size_t offset = 0; offset < size; offset += REWIND_PAGE_SIZE) {
+        size_t length = std::min(REWIND_PAGE_SIZE, size - offset);
+        if (memcmp(older + offset, newer + offset, length) == 0)
+            // Most pages don't change from one frame to the next
+            continue;
+
+        uint32_t page = offset / REWIND_PAGE_SIZE;
+        uint32_t encoded = encode_page(older + offset, newer + offset, length, output + written + PAGE_HEADER_SIZE);
+        memcpy(output + written, &page, sizeof(page));
+        memcpy(output + written + sizeof(page), &encoded, sizeof(encoded));
+        written += PAGE_HEADER_SIZE + encoded;
+    }
+
+    return written;
+}
+
+// XORs the page and run-length encodes the result.
+// Never writes more than length + TOKEN_HEADER_SIZE bytes.
+static size_t melonds::rewind::encode_page(const uint8_t *older, const uint8_t *newer, size_t length, uint8_t *output) noexcept {
+    const size_t limit = length + TOKEN_HEADER_SIZE;
+    size_t written = 0;
+    size_t i = 0;
+    while (i < length) {
+        size_t run_start = i;
+
+        // Skip unchanged bytes, a word at a time where possible
+        while (i + sizeof(uint64_t) <= length) {
+            uint64_t a, b;
+            memcpy(&a, older + i, sizeof(a));
+            memcpy(&b, newer + i, sizeof(b));
+            if (a != b)
+                break;
+            i += sizeof(uint64_t);
+        }
+        while (i < length && older[i] == newer[i]) {
+            ++i;
+        }
+
+        size_t literal_start = i;
+        while (i < length && older[i] != newer[i]) {
+            ++i;
+        }
+
+        uint16_t unchanged = literal_start - run_start;
+        uint16_t changed = i - literal_start;
+        if (written + TOKEN_HEADER_SIZE + changed > limit) {
+            // If the page changed too much for run-length encoding to help, store it verbatim
+            uint16_t all = length;
+            uint16_t none = 0;
+            memcpy(output, &none, sizeof(none));
+            memcpy(output + sizeof(none), &all, sizeof(all));
+            for (size_t j = 0; j < length; ++j) {
+                output[TOKEN_HEADER_SIZE + j] = older[j] ^ newer[j];
+            }
+            return limit;
+        }
+
+        memcpy(output + written, &unchanged, sizeof(unchanged));
+        memcpy(output + written + sizeof(unchanged), &changed, sizeof(changed));
+        written += TOKEN_HEADER_SIZE;
+        for (size_t j = literal_start; j < i; ++j) {
+            output[written++] = older[j] ^ newer[j];
+        }
+    }
+
+    return written;
+}
+
+static void melonds::rewind::apply_delta(const uint8_t *delta, size_t delta_length, uint8_t *state, size_t size) noexcept {
+    size_t position = 0;
+    while (position + PAGE_HEADER_SIZE <= delta_length) {
+        uint32_t page, encoded;
+        memcpy(&page, delta + position, sizeof(page));
+        memcpy(&encoded, delta + position + sizeof(page), sizeof(encoded));
+        position += PAGE_HEADER_SIZE;
+
+        size_t offset = static_cast<size_t>(page) * REWIND_PAGE_SIZE;
+        size_t page_end = std::min(offset + REWIND_PAGE_SIZE, size);
+        size_t end = position + encoded;
+        size_t cursor = offset;
+        while (position + TOKEN_HEADER_SIZE <= end) {
+            uint16_t unchanged, changed;
+            memcpy(&unchanged, delta + position, sizeof(unchanged));
+            memcpy(&changed, delta + position + sizeof(unchanged), sizeof(changed));
+            position += TOKEN_HEADER_SIZE;
+
+            cursor += unchanged;
+            for (size_t j = 0; j < changed && cursor < page_end; ++j) {
+                state[cursor++] ^= delta[position + j];
+            }
+            position += changed;
+        }
+
+        position = end;
+    }
+}
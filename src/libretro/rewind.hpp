@@ -0,0 +1,63 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_REWIND_HPP
+#define MELONDS_DS_REWIND_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace melonds::rewind {
+    using std::size_t;
+
+    /// Savestates are compared in pages of this size;
+    /// only the pages that changed since the previous snapshot are stored.
+    constexpr size_t REWIND_PAGE_SIZE = 4096;
+
+    struct RewindStats {
+        /// Number of snapshots that can currently be rewound through.
+        size_t snapshots;
+
+        /// Bytes of the budget currently used by stored deltas.
+        size_t used_bytes;
+
+        /// The configured memory budget, in bytes.
+        size_t budget_bytes;
+    };
+
+    /// Prepares the rewind buffer according to the current configuration.
+    /// Memory isn't allocated until the first snapshot is taken.
+    void Init();
+
+    /// Logs memory use and timing statistics and frees the rewind buffer.
+    void DeInit();
+
+    /// Records the emulator's state if rewinding is enabled and enough frames have passed.
+    /// Call once per frame, after NDS::RunFrame.
+    void Snapshot();
+
+    /// Restores the emulator to the state of the previous snapshot.
+    /// If there's no earlier snapshot, restores the oldest one that's left.
+    /// \return \c false if rewinding is disabled or no snapshot has been taken yet.
+    bool StepBack();
+
+    /// Discards all snapshots, e.g. after the emulator is reset.
+    void Clear();
+
+    RewindStats Stats();
+}
+
+#endif //MELONDS_DS_REWIND_HPP
@@ -0,0 +1,139 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_RINGBUFFER_HPP
+#define MELONDS_DS_RINGBUFFER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace melonds {
+    using std::size_t;
+
+    /// A lock-free ring buffer with exactly one producer thread and one consumer thread.
+    /// Neither side ever blocks; writes that don't fit and reads that can't be satisfied
+    /// are truncated, and the caller decides what to do about it.
+    template<typename T>
+    class SpscRingBuffer {
+        static_assert(std::is_trivially_copyable_v<T>, "SpscRingBuffer only supports trivially-copyable types");
+    public:
+        /// \param capacity The minimum number of elements the buffer must hold.
+        /// Will be rounded up to the next power of two.
+        explicit SpscRingBuffer(size_t capacity) :
+            _capacity(round_up_pow2(capacity)),
+            _mask(_capacity - 1),
+            _buffer(std::make_unique<T[]>(_capacity)),
+            _head(0),
+            _tail(0) {
+        }
+
+        SpscRingBuffer(const SpscRingBuffer &) = delete;
+
+        SpscRingBuffer(SpscRingBuffer &&) = delete;
+
+        SpscRingBuffer &operator=(const SpscRingBuffer &) = delete;
+
+        /// Copies up to \c count elements into the buffer.
+        /// Must only be called by the producer.
+        /// \return The number of elements actually written.
+        size_t Write(const T *data, size_t count) noexcept {
+            size_t head = _head.load(std::memory_order_relaxed);
+            size_t tail = _tail.load(std::memory_order_acquire);
+            size_t writable = std::min(count, _capacity - (head - tail));
+
+            size_t offset = head & _mask;
+            size_t first = std::min(writable, _capacity - offset);
+            memcpy(&_buffer[offset], data, first * sizeof(T));
+            memcpy(&_buffer[0], data + first, (writable - first) * sizeof(T));
+
+            _head.store(head + writable, std::memory_order_release);
+            return writable;
+        }
+
+        /// Copies up to \c count elements out of the buffer.
+        /// Must only be called by the consumer.
+        /// \return The number of elements actually read.
+        size_t Read(T *data, size_t count) noexcept {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            size_t head = _head.load(std::memory_order_acquire);
+            size_t readable = std::min(count, head - tail);
+
+            size_t offset = tail & _mask;
+            size_t first = std::min(readable, _capacity - offset);
+            memcpy(data, &_buffer[offset], first * sizeof(T));
+            memcpy(data + first, &_buffer[0], (readable - first) * sizeof(T));
+
+            _tail.store(tail + readable, std::memory_order_release);
+            return readable;
+        }
+
+        /// Discards up to \c count elements from the front of the buffer.
+        /// Must only be called by the consumer.
+        /// \return The number of elements actually discarded.
+        size_t Skip(size_t count) noexcept {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            size_t head = _head.load(std::memory_order_acquire);
+            size_t skipped = std::min(count, head - tail);
+
+            _tail.store(tail + skipped, std::memory_order_release);
+            return skipped;
+        }
+
+        /// The number of elements waiting to be read.
+        /// Only an estimate if called from a thread that isn't the producer or consumer.
+        [[nodiscard]] size_t Size() const noexcept {
+            return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+        }
+
+        [[nodiscard]] size_t Free() const noexcept {
+            return _capacity - Size();
+        }
+
+        [[nodiscard]] size_t Capacity() const noexcept {
+            return _capacity;
+        }
+
+        /// Empties the buffer.
+        /// Not thread-safe; only call this when neither the producer nor the consumer is active.
+        void Clear() noexcept {
+            _head.store(0, std::memory_order_relaxed);
+            _tail.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        static constexpr size_t round_up_pow2(size_t n) noexcept {
+            size_t result = 1;
+            while (result < n) result <<= 1;
+            return result;
+        }
+
+        const size_t _capacity;
+        const size_t _mask;
+        std::unique_ptr<T[]> _buffer;
+
+        // The indexes grow without bound (and wrap around on overflow),
+        // so head - tail is always the number of elements in the buffer.
+        // They're on separate cache lines so that the producer and consumer don't contend.
+        alignas(64) std::atomic<size_t> _head; // Next index to write; owned by the producer
+        alignas(64) std::atomic<size_t> _tail; // Next index to read; owned by the consumer
+    };
+}
+
+#endif //MELONDS_DS_RINGBUFFER_HPP
@@ -0,0 +1,350 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "savewriter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <streams/file_stream.h>
+#include <streams/rzip_stream.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include "atomicfile.hpp"
+#include "environment.hpp"
+#include "timing.hpp"
+
+/// The emulation thread copies each dirty range into a pending buffer and moves on.
+/// The writer thread merges the pending range into its own complete copy of the file,
+/// then writes just that range in place (or the whole file, if it has to be recreated).
+namespace melonds::savewriter {
+    static std::string _path;
+    static u32 _length = 0;
+    static bool _compressed = false;
+
+    // Written by the emulation thread; only the bytes in [_pending_start, _pending_end) are meaningful
+    static std::vector<u8> _pending;
+    static u32 _pending_start = 0;
+    static u32 _pending_end = 0;
+
+    // The writer's complete copy of the file's intended contents
+    static std::vector<u8> _mirror;
+
+    // True until the mirror has been filled in completely
+    static bool _needs_full_copy = true;
+
+    // True if the file on disk can't be trusted to have the right length, so it must be rewritten entirely
+    static bool _needs_full_write = true;
+
+    static TimingStats _submit_timing;
+    static TimingStats _write_timing;
+    static uint64_t _bytes_written = 0;
+    static uint64_t _submissions = 0;
+
+#ifdef HAVE_THREADS
+    static sthread_t *_worker = nullptr;
+    static slock_t *_lock = nullptr;
+    static scond_t *_condition = nullptr;
+    static bool _stopping = false;
+    static bool _busy = false;
+
+    static bool start_worker();
+    static void worker_main(void *);
+#endif
+
+    static bool write(u32 start, u32 end) noexcept;
+    static bool write_in_place(u32 start, u32 end) noexcept;
+    static bool write_whole_file() noexcept;
+}
+
+void melonds::savewriter::Init() {
+    _submit_timing.Reset();
+    _write_timing.Reset();
+    _bytes_written = 0;
+    _submissions = 0;
+}
+
+void melonds::savewriter::DeInit() {
+#ifdef HAVE_THREADS
+    if (_worker) {
+        // The worker writes whatever's still pending before it exits
+        slock_lock(_lock);
+        _stopping = true;
+        scond_broadcast(_condition);
+        slock_unlock(_lock);
+
+        sthread_join(_worker);
+        _worker = nullptr;
+    }
+
+    if (_condition) {
+        scond_free(_condition);
+        _condition = nullptr;
+    }
+
+    if (_lock) {
+        slock_free(_lock);
+        _lock = nullptr;
+    }
+
+    _stopping = false;
+    _busy = false;
+#endif
+
+    if (_submissions > 0) {
+        retro::info(
+            "Submitted %llu save writes, taking %.1fus each on the emulation thread (max %lldus); "
+            "wrote %llu bytes in %llu writes, taking %.1fms each (max %.1fms)",
+            static_cast<unsigned long long>(_submissions),
+            _submit_timing.Average(),
+            static_cast<long long>(_submit_timing.Max()),
+            static_cast<unsigned long long>(_bytes_written),
+            static_cast<unsigned long long>(_write_timing.Count()),
+            _write_timing.Average() / 1000.0,
+            _write_timing.Max() / 1000.0
+        );
+    }
+
+    _path.clear();
+    _length = 0;
+    _pending = std::vector<u8>();
+    _mirror = std::vector<u8>();
+    _pending_start = 0;
+    _pending_end = 0;
+    _needs_full_copy = true;
+    _needs_full_write = true;
+}
+
+void melonds::savewriter::Submit(const char *path, const u8 *data, u32 length, u32 start, u32 end, bool compressed) {
+    if (!path || !data || length == 0)
+        return;
+
+    ScopedTimer timer(_submit_timing);
+    _submissions++;
+
+#ifdef HAVE_THREADS
+    if (!_worker && !start_worker()) {
+        retro::error("Failed to start the save writer thread, writing on the emulation thread instead");
+    }
+
+    if (_lock)
+        slock_lock(_lock);
+#endif
+
+    if (_path != path || _length != length || _compressed != compressed) {
+        // If this is a different file than last time (or its size changed)...
+#ifdef HAVE_THREADS
+        while (_lock && _busy) {
+            // The writer is still using the mirror; this only happens if the game changes its save size mid-session
+            scond_wait(_condition, _lock);
+        }
+#endif
+        _path = path;
+        _length = length;
+        _compressed = compressed;
+        _pending.assign(length, 0);
+        _mirror.assign(length, 0);
+        _pending_start = 0;
+        _pending_end = 0;
+        _needs_full_copy = true;
+        _needs_full_write = true;
+    }
+
+    if (_needs_full_copy) {
+        // The mirror has to be complete before we can write only parts of it
+        start = 0;
+        end = length;
+        _needs_full_copy = false;
+    }
+
+    end = std::min(end, length);
+    if (start < end) {
+        memcpy(_pending.data() + start, data + start, end - start);
+        if (_pending_start < _pending_end) {
+            // If the writer hasn't picked up the last submission yet, fold this one into it
+            _pending_start = std::min(_pending_start, start);
+            _pending_end = std::max(_pending_end, end);
+        } else {
+            _pending_start = start;
+            _pending_end = end;
+        }
+    }
+
+#ifdef HAVE_THREADS
+    if (_lock) {
+        scond_broadcast(_condition);
+        slock_unlock(_lock);
+        return;
+    }
+#endif
+
+    // Without a writer thread, the best we can do is write it now
+    if (_pending_start < _pending_end) {
+        memcpy(_mirror.data() + _pending_start, _pending.data() + _pending_start, _pending_end - _pending_start);
+        write(_pending_start, _pending_end);
+        _pending_start = 0;
+        _pending_end = 0;
+    }
+}
+
+void melonds::savewriter::Wait() {
+#ifdef HAVE_THREADS
+    if (!_lock)
+        return;
+
+    slock_lock(_lock);
+    while (_busy || _pending_start < _pending_end) {
+        scond_wait(_condition, _lock);
+    }
+    slock_unlock(_lock);
+#endif
+}
+
+#ifdef HAVE_THREADS
+static bool melonds::savewriter::start_worker() {
+    _stopping = false;
+    _busy = false;
+    _lock = slock_new();
+    _condition = scond_new();
+    if (_lock && _condition) {
+        _worker = sthread_create(worker_main, nullptr);
+    }
+
+    if (!_worker) {
+        if (_condition) {
+            scond_free(_condition);
+            _condition = nullptr;
+        }
+
+        if (_lock) {
+            slock_free(_lock);
+            _lock = nullptr;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static void melonds::savewriter::worker_main(void *) {
+    slock_lock(_lock);
+    while (true) {
+        if (_pending_start >= _pending_end) {
+            // If there's nothing to write...
+            if (_stopping)
+                break;
+
+            scond_wait(_condition, _lock);
+            continue;
+        }
+
+        // Only the dirty bytes are copied while the emulation thread might be waiting on the lock
+        u32 start = _pending_start;
+        u32 end = _pending_end;
+        memcpy(_mirror.data() + start, _pending.data() + start, end - start);
+        _pending_start = 0;
+        _pending_end = 0;
+        _busy = true;
+        slock_unlock(_lock);
+
+        // Submit won't replace the mirror while we're busy
+        write(start, end);
+
+        slock_lock(_lock);
+        _busy = false;
+        scond_broadcast(_condition);
+    }
+    slock_unlock(_lock);
+}
+#endif
+
+static bool melonds::savewriter::write(u32 start, u32 end) noexcept {
+    ScopedTimer timer(_write_timing);
+
+    if (!_needs_full_write && !_compressed && write_in_place(start, end)) {
+        _bytes_written += end - start;
+        return true;
+    }
+
+    // If the file is missing, has the wrong size, or couldn't be updated in place...
+    if (write_whole_file()) {
+        _needs_full_write = false;
+        _bytes_written += _length;
+        return true;
+    }
+
+    _needs_full_write = true;
+    return false;
+}
+
+static bool melonds::savewriter::write_in_place(u32 start, u32 end) noexcept {
+    RFILE *file = filestream_open(
+        _path.c_str(),
+        RETRO_VFS_FILE_ACCESS_READ_WRITE | RETRO_VFS_FILE_ACCESS_UPDATE_EXISTING,
+        RETRO_VFS_FILE_ACCESS_HINT_NONE
+    );
+
+    if (!file)
+        return false;
+
+    if (filestream_get_size(file) != _length) {
+        // If someone else changed the file behind our back...
+        filestream_close(file);
+        return false;
+    }
+
+    bool ok = filestream_seek(file, start, RETRO_VFS_SEEK_POSITION_START) == 0 &&
+              filestream_write(file, _mirror.data() + start, end - start) == static_cast<int64_t>(end - start) &&
+              filestream_flush(file) == 0;
+
+    filestream_close(file);
+
+    if (!ok) {
+        retro::warn("Failed to update bytes [%u, %u) of \"%s\" in place", start, end, _path.c_str());
+    }
+
+    return ok;
+}
+
+static bool melonds::savewriter::write_whole_file() noexcept {
+    // Written to a temporary file first so that a crash mid-write doesn't destroy the existing save
+    std::string temp_path = _path + ".tmp";
+#ifdef HAVE_ZLIB
+    bool written = _compressed ?
+        rzipstream_write_file(temp_path.c_str(), _mirror.data(), _length) :
+        filestream_write_file(temp_path.c_str(), _mirror.data(), _length);
+#else
+    // rzip needs zlib; the frontend reads uncompressed saves just as well
+    bool written = filestream_write_file(temp_path.c_str(), _mirror.data(), _length);
+#endif
+    if (!written) {
+        retro::error("Failed to write %u-byte save data to \"%s\"", _length, temp_path.c_str());
+        filestream_delete(temp_path.c_str());
+        return false;
+    }
+
+    if (!RenameOver(temp_path.c_str(), _path.c_str())) {
+        retro::error("Failed to move save data from \"%s\" to \"%s\"", temp_path.c_str(), _path.c_str());
+        return false;
+    }
+
+    retro::debug("Wrote %u-byte save data to \"%s\"%s", _length, _path.c_str(), _compressed ? " (rzip)" : "");
+    return true;
+}
@@ -0,0 +1,45 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_SAVEWRITER_HPP
+#define MELONDS_DS_SAVEWRITER_HPP
+
+#include <types.h>
+
+/// Writes save data to disk on a background thread,
+/// so that the emulation thread never waits on storage.
+namespace melonds::savewriter {
+    /// Resets the writer's statistics. The background thread is started on the first submission.
+    void Init();
+
+    /// Waits for every submitted write to finish, stops the background thread,
+    /// and logs how much was written and how long it took.
+    void DeInit();
+
+    /// Queues part of a save file to be written to \c path.
+    /// Only the bytes in [start, end) are copied, so this is cheap to call with small updates.
+    /// If the previous submission hasn't been written yet, the two are merged.
+    /// \param data The entire save buffer.
+    /// \param length The length of the entire save buffer, which is also the (uncompressed) length of the file.
+    /// \param compressed If true, the file is written in libretro's rzip format.
+    /// Compressed files are always rewritten in full, but the compression happens on the writer thread.
+    void Submit(const char *path, const u8 *data, u32 length, u32 start, u32 end, bool compressed = false);
+
+    /// Blocks until every submitted write has finished.
+    void Wait();
+}
+
+#endif //MELONDS_DS_SAVEWRITER_HPP
@@ -17,6 +17,7 @@
 #include "libretro.hpp"
 #include "screenlayout.hpp"
 #include "config.hpp"
+#include "audio.hpp"
 #include <frontend/qt_sdl/Config.h>
 #include <functional>
 #include <cstring>
@@ -327,7 +328,7 @@ PUBLIC_SYMBOL void retro_get_system_av_info(struct retro_system_av_info *info) {
     using melonds::screen_layout_data;
 
     info->timing.fps = 32.0f * 1024.0f * 1024.0f / 560190.0f;
-    info->timing.sample_rate = 32.0f * 1024.0f;
+    info->timing.sample_rate = melonds::audio::OutputSampleRate();
     info->geometry.base_width = screen_layout_data.buffer_width;
     info->geometry.base_height = screen_layout_data.buffer_height;
     info->geometry.max_width = screen_layout_data.buffer_width;
@@ -0,0 +1,71 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "task.hpp"
+
+#include <features/features_cpu.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include "environment.hpp"
+
+melonds::Task::Task(const char *name, std::function<void()> work) : _name(name), _work(std::move(work)) {
+#ifdef HAVE_THREADS
+    _thread = sthread_create(Run, this);
+    if (_thread)
+        return;
+
+    retro::warn("Failed to start a thread for %s, running it now instead", _name);
+#endif
+    Run(this);
+}
+
+melonds::Task::~Task() noexcept {
+    try {
+        Wait();
+    }
+    catch (...) {
+        // The owner already gave up on this task (probably because another one failed)
+    }
+}
+
+void melonds::Task::Wait() {
+#ifdef HAVE_THREADS
+    if (_thread) {
+        sthread_join(_thread);
+        _thread = nullptr;
+    }
+#endif
+
+    if (_exception) {
+        std::exception_ptr exception = _exception;
+        _exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+void melonds::Task::Run(void *task) noexcept {
+    auto *self = static_cast<Task *>(task);
+    retro_time_t start = cpu_features_get_time_usec();
+    try {
+        self->_work();
+    }
+    catch (...) {
+        self->_exception = std::current_exception();
+    }
+    self->_duration = cpu_features_get_time_usec() - start;
+}
@@ -0,0 +1,73 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_TASK_HPP
+#define MELONDS_DS_TASK_HPP
+
+#include <exception>
+#include <functional>
+
+#include <libretro.h>
+
+#ifdef HAVE_THREADS
+struct sthread;
+#endif
+
+namespace melonds {
+    /// A piece of work that runs on its own thread (or immediately, if threads aren't available).
+    /// Any exception it throws is rethrown by Wait on the thread that waits for it.
+    class Task {
+    public:
+        /// Starts \c work on a new thread.
+        /// \param name Identifies the task in the log; must outlive the task.
+        Task(const char *name, std::function<void()> work);
+
+        /// Waits for the task to finish, discarding any exception it threw.
+        ~Task() noexcept;
+
+        Task(const Task &) = delete;
+
+        Task(Task &&) = delete;
+
+        Task &operator=(const Task &) = delete;
+
+        /// Blocks until the task finishes. Safe to call more than once.
+        /// \throws Whatever the task threw, if anything.
+        void Wait();
+
+        /// How long the task took to run, in microseconds; only meaningful after Wait returns.
+        [[nodiscard]] retro_time_t Duration() const noexcept {
+            return _duration;
+        }
+
+        [[nodiscard]] const char *Name() const noexcept {
+            return _name;
+        }
+
+    private:
+        static void Run(void *task) noexcept;
+
+        const char *_name;
+        std::function<void()> _work;
+        std::exception_ptr _exception;
+        retro_time_t _duration = 0;
+#ifdef HAVE_THREADS
+        sthread *_thread = nullptr;
+#endif
+    };
+}
+
+#endif //MELONDS_DS_TASK_HPP
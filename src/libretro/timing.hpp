@@ -0,0 +1,80 @@
+/*
+    Copyright 2023 Jesse Talavera-Greenberg
+
+    melonDS DS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS DS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS DS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_DS_TIMING_HPP
+#define MELONDS_DS_TIMING_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include <libretro.h>
+#include <features/features_cpu.h>
+
+namespace melonds {
+    /// Accumulates durations (in microseconds) so that we can report
+    /// how much time the core spends on a particular task.
+    class TimingStats {
+    public:
+        void Add(retro_time_t usec) noexcept {
+            _count++;
+            _total += usec;
+            _min = std::min(_min, usec);
+            _max = std::max(_max, usec);
+        }
+
+        void Reset() noexcept {
+            *this = TimingStats();
+        }
+
+        [[nodiscard]] uint64_t Count() const noexcept { return _count; }
+        [[nodiscard]] retro_time_t Total() const noexcept { return _total; }
+        [[nodiscard]] retro_time_t Min() const noexcept { return _count ? _min : 0; }
+        [[nodiscard]] retro_time_t Max() const noexcept { return _max; }
+        [[nodiscard]] double Average() const noexcept {
+            return _count ? static_cast<double>(_total) / _count : 0.0;
+        }
+
+    private:
+        uint64_t _count = 0;
+        retro_time_t _total = 0;
+        retro_time_t _min = std::numeric_limits<retro_time_t>::max();
+        retro_time_t _max = 0;
+    };
+
+    /// Adds the time between its construction and destruction to a TimingStats.
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(TimingStats &stats) noexcept :
+            _stats(stats),
+            _start(cpu_features_get_time_usec()) {
+        }
+
+        ~ScopedTimer() noexcept {
+            _stats.Add(cpu_features_get_time_usec() - _start);
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        TimingStats &_stats;
+        retro_time_t _start;
+    };
+}
+
+#endif //MELONDS_DS_TIMING_HPP